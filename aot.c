@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "aot.h"
+#include "hash_table.h"
+
+ObjFunction* aotNewFunction(VM* vm, const char* name, u32 arity) {
+    ObjFunction* function = newFunction(vm);
+    function->arity = arity;
+    function->name = copyString(vm, name, (u32)strlen(name));
+    return function;
+}
+
+Value aotString(VM* vm, const char* chars, u32 length) {
+    return OBJ_VAL(copyString(vm, chars, length));
+}
+
+AotStatus aotError(VM* vm, u32 line, const char* function,
+                   const char* message) {
+    flushOutput(&vm->output);
+    if (message != NULL) fprintf(vm->err, "%s\n", message);
+    fprintf(vm->err, "[line %d] in ", line);
+    if (function == NULL) {
+        fprintf(vm->err, "script\n");
+    } else {
+        fprintf(vm->err, "%s()\n", function);
+    }
+    return AOT_FAILED;
+}
+
+static AotEntry findEntry(const AotProgram* program, Value callee) {
+    if (!isObjType(callee, OBJ_FUNCTION)) return NULL;
+    ObjFunction* function = functionFrom(callee);
+    for (u32 i = 0; i < program->count; i++) {
+        if (program->functions[i] == function) return program->entries[i];
+    }
+    return NULL;
+}
+
+// Checks a call and makes it if the callee is a native. A compiled callee
+// is left to the caller: its code goes in *entry and the result is
+// AOT_CALL_STAGED.
+static AotCallStatus startCall(VM* vm, const AotProgram* program,
+                               Value* args, u32 argCount, Value* result,
+                               AotEntry* entry) {
+    Value callee = args[0];
+    *entry = findEntry(program, callee);
+    if (*entry != NULL) {
+        ObjFunction* function = functionFrom(callee);
+        if (argCount != function->arity) {
+            runtimeError(vm, "Expected %d arguments but got %d.",
+                         function->arity, argCount);
+            return AOT_CALL_FAILED;
+        }
+        return AOT_CALL_STAGED;
+    }
+    if (isObjType(callee, OBJ_NATIVE)) {
+        ObjNative* native = nativeFrom(callee);
+        if (native->arity != NATIVE_VARIADIC &&
+            argCount != (u32)native->arity) {
+            runtimeError(vm, "Expected %d arguments but got %d.",
+                         native->arity, argCount);
+            return AOT_CALL_FAILED;
+        }
+        // Natives run in the caller's frame, so their errors are the
+        // caller's.
+        if (!native->function(vm, argCount, args + 1, result)) {
+            return AOT_CALL_FAILED;
+        }
+        return AOT_CALL_OK;
+    }
+
+    runtimeError(vm, "Can only call functions.");
+    return AOT_CALL_FAILED;
+}
+
+bool aotCall(VM* vm, const AotProgram* program, u32 depth, Value* args,
+             u32 argCount, Value* result) {
+    AotEntry entry;
+    AotCallStatus status = startCall(vm, program, args, argCount, result,
+                                     &entry);
+    if (status != AOT_CALL_STAGED) return status == AOT_CALL_OK;
+    if (depth == FRAMES_MAX) {
+        runtimeError(vm, "Stack overflow.");
+        return false;
+    }
+
+    for ever {
+        switch (entry(vm, depth + 1, args, result)) {
+            case AOT_RETURNED: return true;
+            case AOT_FAILED:   return false;
+            case AOT_TAIL_CALL:
+                // Entries copy their arguments out first thing, so the
+                // next tail call can reuse the same slots.
+                args = vm->stack;
+                entry = findEntry(program, args[0]);
+                break;
+        }
+    }
+}
+
+AotCallStatus aotTailCall(VM* vm, const AotProgram* program, Value* args,
+                          u32 argCount, Value* result) {
+    AotEntry entry;
+    AotCallStatus status = startCall(vm, program, args, argCount, result,
+                                     &entry);
+    if (status == AOT_CALL_STAGED) {
+        memcpy(vm->stack, args, sizeof(Value) * (argCount + 1));
+    }
+    return status;
+}
+
+bool aotGetGlobal(VM* vm, Value name, Value* result) {
+    GetResult found = hashTableGet(&vm->globals, stringFrom(name));
+    if (!found.found) {
+        runtimeError(vm, "Undefined variable '%s'.", stringFrom(name)->chars);
+        return false;
+    }
+    *result = found.value;
+    return true;
+}
+
+void aotDefineGlobal(VM* vm, Value name, Value value) {
+    hashTableSet(vm, &vm->globals, stringFrom(name), value);
+}
+
+bool aotSetGlobal(VM* vm, Value name, Value value) {
+    if (hashTableSet(vm, &vm->globals, stringFrom(name), value)) {
+        hashTableDelete(&vm->globals, stringFrom(name));
+        runtimeError(vm, "Undefined variable '%s'.", stringFrom(name)->chars);
+        return false;
+    }
+    return true;
+}
+
+bool aotUpdateGlobal(VM* vm, Value name, u8 op, Value operand,
+                     Value* result) {
+    Value* slot = hashTableGetSlot(&vm->globals, stringFrom(name));
+    if (slot == NULL) {
+        runtimeError(vm, "Undefined variable '%s'.", stringFrom(name)->chars);
+        return false;
+    }
+
+    if (op == OP_ADD && isObjType(operand, OBJ_STRING)) {
+        if (!aotAdd(vm, *slot, operand, slot)) return false;
+    } else if (!AOT_NUMBERS(*slot, operand)) {
+        runtimeError(vm, "Operands must be numbers.");
+        return false;
+    } else {
+        switch (op) {
+            case OP_ADD:      *slot = numberAdd(*slot, operand); break;
+            case OP_SUBTRACT: *slot = numberSubtract(*slot, operand); break;
+            case OP_MULTIPLY: *slot = numberMultiply(*slot, operand); break;
+            case OP_DIVIDE:   *slot = numberDivide(*slot, operand); break;
+        }
+    }
+    *result = *slot;
+    return true;
+}
+
+bool aotStepGlobal(VM* vm, Value name, i64 delta, Value* result) {
+    Value* slot = hashTableGetSlot(&vm->globals, stringFrom(name));
+    if (slot == NULL) {
+        runtimeError(vm, "Undefined variable '%s'.", stringFrom(name)->chars);
+        return false;
+    }
+    if (!isNumber(*slot)) {
+        runtimeError(vm, "operand must be a number.");
+        return false;
+    }
+    *slot = numberAdd(*slot, INT_VAL(delta));
+    *result = *slot;
+    return true;
+}
+
+bool aotAdd(VM* vm, Value a, Value b, Value* result) {
+    if (AOT_NUMBERS(a, b)) {
+        *result = numberAdd(a, b);
+    } else if (isObjType(a, OBJ_STRING) && isObjType(b, OBJ_STRING)) {
+        *result = OBJ_VAL(concatStrings(vm, stringFrom(a), stringFrom(b)));
+    } else {
+        runtimeError(vm, "Operands must be two numbers or two strings.");
+        return false;
+    }
+    return true;
+}
+
+void aotPrint(VM* vm, Value value) {
+    writeValue(&vm->output, value);
+    writeChar(&vm->output, '\n');
+}
+
+Value aotBuildList(VM* vm, const Value* items, u32 count) {
+    ObjList* list = newList(vm, count);
+    if (count > 0) memcpy(list->items.values, items, sizeof(Value) * count);
+    list->items.count = count;
+    return OBJ_VAL(list);
+}
+
+bool aotGetIndex(VM* vm, Value list, Value index, Value* result) {
+    if (!isObjType(list, OBJ_LIST)) {
+        runtimeError(vm, "Only lists can be indexed.");
+        return false;
+    }
+    u32 slot;
+    if (!checkListIndex(vm, listFrom(list), index, &slot)) return false;
+    *result = listFrom(list)->items.values[slot];
+    return true;
+}
+
+bool aotSetIndex(VM* vm, Value list, Value index, Value value) {
+    if (!isObjType(list, OBJ_LIST)) {
+        runtimeError(vm, "Only lists can be indexed.");
+        return false;
+    }
+    u32 slot;
+    if (!checkListIndex(vm, listFrom(list), index, &slot)) return false;
+    listFrom(list)->items.values[slot] = value;
+    return true;
+}
+
+bool aotListLength(VM* vm, Value list, Value* result) {
+    if (!isObjType(list, OBJ_LIST)) {
+        runtimeError(vm, "Only lists have a length.");
+        return false;
+    }
+    *result = INT_VAL(listFrom(list)->items.count);
+    return true;
+}
+
+bool aotListAppend(VM* vm, Value list, Value value) {
+    if (!isObjType(list, OBJ_LIST)) {
+        runtimeError(vm, "Can only append to a list.");
+        return false;
+    }
+    appendList(vm, listFrom(list), value);
+    return true;
+}
+
+// The kernels work on the VM stack, which compiled code otherwise leaves
+// empty.
+bool aotListKernel(VM* vm, ListKernel kernel, const Value* operands,
+                   Value* result) {
+    u32 count = listKernelArity(kernel) + 1;
+    for (u32 i = 0; i < count; i++) push(vm, operands[i]);
+    if (!runListKernel(vm, kernel)) return false;
+    *result = pop(vm);
+    return true;
+}
+
+int aotRunScript(VM* vm, const AotProgram* program) {
+    Value slots[1] = { NIL_VAL };
+    Value result;
+    vm->output.file = vm->out;
+    bool ok = program->entries[0](vm, 1, slots, &result) == AOT_RETURNED;
+    flushOutput(&vm->output);
+    return ok ? OK : 70;
+}
@@ -0,0 +1,87 @@
+#ifndef clox_aot_h
+#define clox_aot_h
+
+#include "common.h"
+#include "list_kernels.h"
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+// Runtime support for the C translation units `clox --emit-c` writes. The
+// generated code keeps the operand stack in C locals and calls in here for
+// anything dynamic: globals, strings, lists, calls and error reporting.
+//
+// Compiled functions have no CallFrame. A failing function prints its own
+// "[line N] in f()" line on the way out, so traces read the same as the
+// interpreter's.
+
+// How a compiled function finished.
+typedef enum {
+    AOT_RETURNED,   // *result holds the return value
+    AOT_FAILED,     // the function printed its trace line
+    AOT_TAIL_CALL,  // it staged a call to run in its place; see aotTailCall
+} AotStatus;
+
+// A compiled function: args[0] is the callee, then the arguments. `depth`
+// counts active calls, for the same "Stack overflow." limit as the VM.
+typedef AotStatus (*AotEntry)(VM* vm, u32 depth, Value* args, Value* result);
+
+// The function objects of one program, paired with their code.
+typedef struct {
+    ObjFunction** functions;
+    const AotEntry* entries;
+    u32 count;
+} AotProgram;
+
+#define AOT_NUMBERS(a, b) (isNumber(a) && isNumber(b))
+
+ObjFunction* aotNewFunction(VM* vm, const char* name, u32 arity);
+Value aotString(VM* vm, const char* chars, u32 length);
+
+// Prints `message`, if any, then this function's trace line. Returns
+// AOT_FAILED so generated code can `return aotError(...)`.
+AotStatus aotError(VM* vm, u32 line, const char* function,
+                   const char* message);
+
+bool aotCall(VM* vm, const AotProgram* program, u32 depth, Value* args,
+             u32 argCount, Value* result);
+
+typedef enum {
+    AOT_CALL_OK,      // a native ran; *result holds its value
+    AOT_CALL_FAILED,  // the caller adds its line
+    AOT_CALL_STAGED,  // the caller returns AOT_TAIL_CALL
+} AotCallStatus;
+
+// A tail call replaces the caller's frame in the VM. A compiled callee is
+// checked and copied to vm->stack rather than called; once the caller
+// returns AOT_TAIL_CALL, the loop in aotCall runs it at the caller's depth.
+// So the C stack stays flat however many tail calls follow one another,
+// and the caller is gone from the trace of an error inside the callee.
+AotCallStatus aotTailCall(VM* vm, const AotProgram* program, Value* args,
+                          u32 argCount, Value* result);
+
+bool aotGetGlobal(VM* vm, Value name, Value* result);
+void aotDefineGlobal(VM* vm, Value name, Value value);
+bool aotSetGlobal(VM* vm, Value name, Value value);
+// Applies `op`, one of OP_ADD, OP_SUBTRACT, OP_MULTIPLY or OP_DIVIDE, to
+// the global in place.
+bool aotUpdateGlobal(VM* vm, Value name, u8 op, Value operand, Value* result);
+bool aotStepGlobal(VM* vm, Value name, i64 delta, Value* result);
+
+bool aotAdd(VM* vm, Value a, Value b, Value* result);
+void aotPrint(VM* vm, Value value);
+
+Value aotBuildList(VM* vm, const Value* items, u32 count);
+bool aotGetIndex(VM* vm, Value list, Value index, Value* result);
+bool aotSetIndex(VM* vm, Value list, Value index, Value value);
+bool aotListLength(VM* vm, Value list, Value* result);
+bool aotListAppend(VM* vm, Value list, Value value);
+// operands[0] is the receiver, then the kernel's argument if it has one.
+bool aotListKernel(VM* vm, ListKernel kernel, const Value* operands,
+                   Value* result);
+
+// Runs a program's top-level function, entries[0], and returns the process
+// exit status, as `clox script.lox` would.
+int aotRunScript(VM* vm, const AotProgram* program);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+#define ALIGN_UP(size) \
+    (((size) + ARENA_ALIGNMENT - 1) & ~(usize)(ARENA_ALIGNMENT - 1))
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    usize size;
+    usize used;
+    usize last;  // offset of the most recent allocation
+};
+
+#define HEADER_SIZE ALIGN_UP(sizeof(ArenaBlock))
+
+static u8* blockData(ArenaBlock* block) {
+    return (u8*)block + HEADER_SIZE;
+}
+
+void initArena(Arena* arena) {
+    arena->blocks = NULL;
+    arena->reserved = 0;
+}
+
+void freeArena(Arena* arena, const Allocator* allocator) {
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        allocator->reallocate(allocator->context, block,
+                              HEADER_SIZE + block->size, 0);
+        block = next;
+    }
+    initArena(arena);
+}
+
+static ArenaBlock* newBlock(Arena* arena, const Allocator* allocator,
+                            usize size) {
+    ArenaBlock* block = allocator->reallocate(allocator->context, NULL, 0,
+                                              HEADER_SIZE + size);
+    if (block == NULL) exit(SYSERR);
+    block->size = size;
+    block->used = 0;
+    block->last = 0;
+    arena->reserved += HEADER_SIZE + size;
+    return block;
+}
+
+static void* arenaAllocate(Arena* arena, const Allocator* allocator,
+                           usize size) {
+    size = ALIGN_UP(size);
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        if (size > ARENA_BLOCK_SIZE / 4) {
+            // Big requests get a block of their own, behind the current
+            // one, so the space left in that is not abandoned.
+            ArenaBlock* own = newBlock(arena, allocator, size);
+            own->used = size;
+            if (block == NULL) {
+                own->next = NULL;
+                arena->blocks = own;
+            } else {
+                own->next = block->next;
+                block->next = own;
+            }
+            return blockData(own);
+        }
+        block = newBlock(arena, allocator, ARENA_BLOCK_SIZE);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    block->last = block->used;
+    block->used += size;
+    return blockData(block) + block->last;
+}
+
+void* arenaResize(Arena* arena, const Allocator* allocator, void* pointer,
+                  usize oldSize, usize newSize) {
+    ArenaBlock* block = arena->blocks;
+    bool newest = pointer != NULL && block != NULL &&
+                  (u8*)pointer == blockData(block) + block->last &&
+                  block->used > block->last;
+
+    if (newSize == 0) {
+        if (newest) block->used = block->last;
+        return NULL;
+    }
+    if (newest && block->size - block->last >= ALIGN_UP(newSize)) {
+        block->used = block->last + ALIGN_UP(newSize);
+        return pointer;
+    }
+    if (pointer != NULL && newSize <= oldSize) return pointer;
+
+    void* result = arenaAllocate(arena, allocator, newSize);
+    if (pointer != NULL) memcpy(result, pointer, oldSize);
+    return result;
+}
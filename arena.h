@@ -0,0 +1,27 @@
+#ifndef clox_arena_h
+#define clox_arena_h
+
+#include "common.h"
+#include "memory.h"
+
+#define ARENA_BLOCK_SIZE (32 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump-pointer storage for compilation artifacts: chunk code, line runs and
+// constants. They all live until the VM goes away, so nothing is freed one
+// at a time; the blocks are handed back to the allocator together.
+typedef struct {
+    ArenaBlock* blocks;  // newest first; only the newest takes allocations
+    usize reserved;      // bytes obtained from the allocator
+} Arena;
+
+void initArena(Arena* arena);
+void freeArena(Arena* arena, const Allocator* allocator);
+// reallocate() for arena memory. The most recent allocation grows and
+// shrinks in place; anything else moves. Freeing only reclaims space when
+// it was the most recent allocation.
+void* arenaResize(Arena* arena, const Allocator* allocator, void* pointer,
+                  usize oldSize, usize newSize);
+
+#endif
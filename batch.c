@@ -0,0 +1,284 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "common.h"
+#include "file.h"
+#include "shared_strings.h"
+#include "vm.h"
+
+typedef struct {
+    const char* path;
+    int status;
+    u64 nanos;
+    char* out;
+    usize outLength;
+    char* err;
+    usize errLength;
+    bool done;
+} BatchJob;
+
+// Each worker owns a contiguous slice of the job list. It takes jobs from
+// the front of its own queue, in script order, and steals from the back of
+// the others once its own queue is empty.
+typedef struct {
+    pthread_mutex_t lock;
+    u32 head;
+    u32 tail;
+} WorkQueue;
+
+typedef struct {
+    BatchJob* jobs;
+    WorkQueue* queues;
+    u32 workerCount;
+    bool sharedStrings;
+    pthread_mutex_t doneLock;
+    pthread_cond_t jobDone;
+} Batch;
+
+typedef struct {
+    Batch* batch;
+    u32 id;
+} Worker;
+
+void initScriptList(ScriptList* scripts) {
+    scripts->paths = NULL;
+    scripts->count = 0;
+    scripts->capacity = 0;
+}
+
+void freeScriptList(ScriptList* scripts) {
+    for (u32 i = 0; i < scripts->count; i++) free(scripts->paths[i]);
+    free(scripts->paths);
+    initScriptList(scripts);
+}
+
+void appendScript(ScriptList* scripts, const char* path, usize length) {
+    if (scripts->capacity <= scripts->count) {
+        scripts->capacity = scripts->capacity < 8 ? 8 : scripts->capacity * 2;
+        scripts->paths = realloc(scripts->paths,
+                                 sizeof(char*) * scripts->capacity);
+        if (scripts->paths == NULL) exit(SYSERR);
+    }
+
+    char* copy = malloc(length + 1);
+    if (copy == NULL) exit(SYSERR);
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+    scripts->paths[scripts->count++] = copy;
+}
+
+bool appendManifest(ScriptList* scripts, const char* manifestPath) {
+    char* manifest = readFile(manifestPath, stderr);
+    if (manifest == NULL) return false;
+
+    for (char* line = manifest; *line != '\0';) {
+        char* end = line;
+        while (*end != '\0' && *end != '\n') end++;
+        char* next = *end == '\0' ? end : end + 1;
+
+        while (*line == ' ' || *line == '\t') line++;
+        while (end > line && (end[-1] == ' ' || end[-1] == '\t' ||
+                              end[-1] == '\r')) {
+            end--;
+        }
+        if (end > line && *line != '#') {
+            appendScript(scripts, line, (usize)(end - line));
+        }
+
+        line = next;
+    }
+
+    free(manifest);
+    return true;
+}
+
+u32 defaultWorkerCount() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (u32)cpus : 1;
+}
+
+static u64 nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000u + (u64)now.tv_nsec;
+}
+
+static void runJob(Batch* batch, BatchJob* job) {
+    u64 start = nowNanos();
+
+    FILE* out = open_memstream(&job->out, &job->outLength);
+    FILE* err = open_memstream(&job->err, &job->errLength);
+    if (out == NULL || err == NULL) exit(SYSERR);
+
+    char* source = readFile(job->path, err);
+    if (source == NULL) {
+        job->status = 74;
+    } else {
+        VM* vm = newVM();
+        vm->out = out;
+        vm->err = err;
+        vm->sharedStrings = batch->sharedStrings;
+        switch (vmInterpret(vm, source)) {
+            case INTERPRET_OK:              job->status = OK; break;
+            case INTERPRET_COMPILE_ERROR:   job->status = 65; break;
+            case INTERPRET_RUNTIME_ERROR:   job->status = 70; break;
+        }
+        freeVM(vm);
+        free(source);
+    }
+
+    fclose(out);
+    fclose(err);
+    job->nanos = nowNanos() - start;
+}
+
+static bool takeOwnJob(WorkQueue* queue, u32* job) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->head < queue->tail;
+    if (found) *job = queue->head++;
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool stealJob(WorkQueue* queue, u32* job) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->head < queue->tail;
+    if (found) *job = --queue->tail;
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool nextJob(Batch* batch, u32 id, u32* job) {
+    if (takeOwnJob(&batch->queues[id], job)) return true;
+
+    for (u32 i = 1; i < batch->workerCount; i++) {
+        u32 victim = (id + i) % batch->workerCount;
+        if (stealJob(&batch->queues[victim], job)) return true;
+    }
+    return false;
+}
+
+static void* workerMain(void* arg) {
+    Worker* worker = (Worker*)arg;
+    Batch* batch = worker->batch;
+
+    u32 index;
+    while (nextJob(batch, worker->id, &index)) {
+        runJob(batch, &batch->jobs[index]);
+
+        pthread_mutex_lock(&batch->doneLock);
+        batch->jobs[index].done = true;
+        pthread_cond_broadcast(&batch->jobDone);
+        pthread_mutex_unlock(&batch->doneLock);
+    }
+    return NULL;
+}
+
+static void printSummary(const Batch* batch, u32 count, u64 wallNanos) {
+    u32 ok = 0, compileErrors = 0, runtimeErrors = 0, ioErrors = 0;
+    u64 totalNanos = 0;
+    u32 slowest = 0;
+    for (u32 i = 0; i < count; i++) {
+        const BatchJob* job = &batch->jobs[i];
+        switch (job->status) {
+            case OK: ok++; break;
+            case 65: compileErrors++; break;
+            case 70: runtimeErrors++; break;
+            default: ioErrors++; break;
+        }
+        if (job->status != OK) {
+            fprintf(stderr, "FAIL %d %s\n", job->status, job->path);
+        }
+        totalNanos += job->nanos;
+        if (job->nanos > batch->jobs[slowest].nanos) slowest = i;
+    }
+
+    fprintf(stderr, "== batch: %u scripts on %u workers ==\n",
+            count, batch->workerCount);
+    fprintf(stderr, "%-15s %u\n", "ok", ok);
+    fprintf(stderr, "%-15s %u\n", "compile errors", compileErrors);
+    fprintf(stderr, "%-15s %u\n", "runtime errors", runtimeErrors);
+    fprintf(stderr, "%-15s %u\n", "io errors", ioErrors);
+    fprintf(stderr, "%-15s %.3f ms\n", "wall", wallNanos / 1e6);
+    fprintf(stderr, "%-15s %.3f ms total, %.3f ms mean\n", "script time",
+            totalNanos / 1e6, totalNanos / 1e6 / count);
+    fprintf(stderr, "%-15s %.3f ms (%s)\n", "slowest",
+            batch->jobs[slowest].nanos / 1e6, batch->jobs[slowest].path);
+}
+
+int runBatch(const ScriptList* scripts, u32 workerCount, bool sharedStrings) {
+    u32 count = scripts->count;
+    if (count == 0) return OK;
+    if (workerCount > count) workerCount = count;
+    if (workerCount == 0) workerCount = 1;
+
+    Batch batch;
+    batch.workerCount = workerCount;
+    batch.sharedStrings = sharedStrings;
+    if (sharedStrings) initSharedStrings();
+    batch.jobs = calloc(count, sizeof(BatchJob));
+    batch.queues = malloc(sizeof(WorkQueue) * workerCount);
+    pthread_t* threads = malloc(sizeof(pthread_t) * workerCount);
+    Worker* workers = malloc(sizeof(Worker) * workerCount);
+    if (batch.jobs == NULL || batch.queues == NULL ||
+        threads == NULL || workers == NULL) {
+        exit(SYSERR);
+    }
+    pthread_mutex_init(&batch.doneLock, NULL);
+    pthread_cond_init(&batch.jobDone, NULL);
+
+    for (u32 i = 0; i < count; i++) batch.jobs[i].path = scripts->paths[i];
+    for (u32 i = 0; i < workerCount; i++) {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.queues[i].head = (u32)((u64)count * i / workerCount);
+        batch.queues[i].tail = (u32)((u64)count * (i + 1) / workerCount);
+    }
+
+    u64 start = nowNanos();
+    for (u32 i = 0; i < workerCount; i++) {
+        workers[i] = (Worker){.batch = &batch, .id = i};
+        if (pthread_create(&threads[i], NULL, workerMain, &workers[i]) != 0) {
+            exit(SYSERR);
+        }
+    }
+
+    // Replay output in script order as soon as each prefix has finished.
+    int status = OK;
+    for (u32 i = 0; i < count; i++) {
+        BatchJob* job = &batch.jobs[i];
+        pthread_mutex_lock(&batch.doneLock);
+        while (!job->done) pthread_cond_wait(&batch.jobDone, &batch.doneLock);
+        pthread_mutex_unlock(&batch.doneLock);
+
+        fwrite(job->out, 1, job->outLength, stdout);
+        fflush(stdout);
+        fwrite(job->err, 1, job->errLength, stderr);
+        free(job->out);
+        free(job->err);
+        job->out = job->err = NULL;
+
+        if (status == OK) status = job->status;
+    }
+
+    for (u32 i = 0; i < workerCount; i++) pthread_join(threads[i], NULL);
+    printSummary(&batch, count, nowNanos() - start);
+
+    for (u32 i = 0; i < workerCount; i++) {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+    }
+    pthread_mutex_destroy(&batch.doneLock);
+    pthread_cond_destroy(&batch.jobDone);
+    if (sharedStrings) freeSharedStrings();
+    free(workers);
+    free(threads);
+    free(batch.queues);
+    free(batch.jobs);
+    return status;
+}
@@ -0,0 +1,27 @@
+#ifndef clox_batch_h
+#define clox_batch_h
+
+#include "common.h"
+
+typedef struct {
+    char** paths;
+    u32 count;
+    u32 capacity;
+} ScriptList;
+
+void initScriptList(ScriptList* scripts);
+void freeScriptList(ScriptList* scripts);
+void appendScript(ScriptList* scripts, const char* path, usize length);
+// Adds every path listed in the manifest, one per line. Blank lines and
+// lines starting with '#' are skipped.
+bool appendManifest(ScriptList* scripts, const char* manifestPath);
+
+u32 defaultWorkerCount(void);
+// Runs every script on its own VM across a pool of worker threads and
+// replays each script's output in list order. With sharedStrings the VMs
+// intern identifiers and literals through one process-wide table. Returns
+// OK if every script succeeded, otherwise the exit status of the first one
+// that failed.
+int runBatch(const ScriptList* scripts, u32 workerCount, bool sharedStrings);
+
+#endif
@@ -13,27 +13,72 @@ void initChunk(Chunk* chunk) {
     initValueArray(&chunk->constants);
 }
 
-void freeChunk(Chunk* chunk) {
-    FREE_ARRAY(u8, chunk->code, chunk->capacity);
-    freeRunTable(&chunk->runTable);
-    freeValueArray(&chunk->constants);
+void freeChunk(VM* vm, Chunk* chunk) {
+    FREE_ARRAY(vm, u8, chunk->code, chunk->capacity, MEM_CHUNK_CODE);
+    freeRunTable(vm, &chunk->runTable);
+    freeValueArray(vm, &chunk->constants);
     initChunk(chunk);
 }
 
-void appendChunk(Chunk* chunk, u8 byte, u32 line) {
+void appendChunk(VM* vm, Chunk* chunk, u8 byte, u32 line) {
     if (chunk->capacity <= chunk->count+1) {
         u32 oldCapacity = chunk->capacity;
         chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(
-            u8, chunk->code, oldCapacity, chunk->capacity
+        chunk->code = GROW_ARRAY(vm,
+            u8, chunk->code, oldCapacity, chunk->capacity, MEM_CHUNK_CODE
         );
     }
 
     chunk->code[chunk->count++] = byte;
-    appendRunTable(&chunk->runTable, line);
+    appendRunTable(vm, &chunk->runTable, line);
 }
 
-u32 addConstant(Chunk *chunk, Value value) {
-    appendValueArray(&chunk->constants, value);
+// Drop already emitted bytes, for peephole rewrites in the compiler.
+void truncateChunk(Chunk* chunk, u32 count) {
+    if (count >= chunk->count) return;
+    chunk->count = count;
+    truncateRunTable(&chunk->runTable, count);
+}
+
+// Opcode byte plus operand bytes, for passes that walk finished bytecode.
+u32 instructionLength(u8 instruction) {
+    switch (instruction) {
+        case OP_CONSTANT:
+        case OP_POPN:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_ADD_GLOBAL:
+        case OP_SUBTRACT_GLOBAL:
+        case OP_MULTIPLY_GLOBAL:
+        case OP_DIVIDE_GLOBAL:
+        case OP_INC_GLOBAL:
+        case OP_DEC_GLOBAL:
+        case OP_INC_LOCAL:
+        case OP_DEC_LOCAL:
+        case OP_BUILD_LIST:
+        case OP_LIST_KERNEL:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            return 2;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+u32 addConstant(VM* vm, Chunk *chunk, Value value) {
+    appendValueArray(vm, &chunk->constants, value);
     return chunk->constants.count - 1;
 }
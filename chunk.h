@@ -11,10 +11,33 @@ typedef enum {
     OP_TRUE,
     OP_FALSE,
     OP_POP,
+    OP_POPN,
+    OP_GET_LOCAL,
+    OP_SET_LOCAL,
     OP_EQUAL,
     OP_GET_GLOBAL,
     OP_DEFINE_GLOBAL,
     OP_SET_GLOBAL,
+    // Read-modify-write of a variable in one step; each pushes the result.
+    OP_ADD_GLOBAL,
+    OP_SUBTRACT_GLOBAL,
+    OP_MULTIPLY_GLOBAL,
+    OP_DIVIDE_GLOBAL,
+    OP_INC_GLOBAL,
+    OP_DEC_GLOBAL,
+    OP_INC_LOCAL,
+    OP_DEC_LOCAL,
+    OP_JUMP,
+    OP_JUMP_IF_FALSE,
+    OP_LOOP,
+    // Fused "compare, then jump if the condition is false" for loop and
+    // branch conditions. Both operands are popped and no bool is pushed.
+    OP_JUMP_IF_NOT_LESS,     // a < b
+    OP_JUMP_IF_NOT_GREATER,  // a > b
+    OP_JUMP_IF_LESS,         // a >= b
+    OP_JUMP_IF_GREATER,      // a <= b
+    OP_JUMP_IF_NOT_EQUAL,    // a == b
+    OP_JUMP_IF_EQUAL,        // a != b
     OP_LESS,
     OP_GREATER,
     OP_ADD,
@@ -23,6 +46,22 @@ typedef enum {
     OP_DIVIDE,
     OP_NOT,
     OP_NEGATE,
+    // Quickened forms. The generic opcode rewrites itself into one of these
+    // once it sees matching operand types, and they rewrite themselves back
+    // when their guard fails.
+    OP_EQUAL_NUM,
+    OP_LESS_NUM,
+    OP_GREATER_NUM,
+    OP_ADD_NUM,
+    OP_ADD_STR,
+    OP_BUILD_LIST,   // count: pops that many items into a new list
+    OP_GET_INDEX,
+    OP_SET_INDEX,
+    OP_LIST_LENGTH,
+    OP_LIST_APPEND,
+    OP_LIST_KERNEL,  // kernel: a ListKernel run over the receiver's items
+    OP_CALL,
+    OP_TAIL_CALL,  // call that replaces the current frame
     OP_RETURN,
     OP_PRINT,
 } OpCode;
@@ -36,8 +75,10 @@ typedef struct {
 } Chunk;
 
 void initChunk(Chunk* chunk);
-void freeChunk(Chunk* chunk);
-void appendChunk(Chunk* chunk, u8 byte, u32 line);
-u32 addConstant(Chunk* chunk, Value value);
+void freeChunk(VM* vm, Chunk* chunk);
+void appendChunk(VM* vm, Chunk* chunk, u8 byte, u32 line);
+void truncateChunk(Chunk* chunk, u32 count);
+u32 instructionLength(u8 instruction);
+u32 addConstant(VM* vm, Chunk* chunk, Value value);
 
 #endif
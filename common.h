@@ -8,7 +8,18 @@
 
 #define ever (;;)
 
+// Defined in vm.h; everything that allocates takes the owning VM.
+typedef struct VM VM;
+
+// Disassembly and instruction traces, written to the program's stdout.
+// Build with -DNO_DEBUG_OUTPUT to get only what the script prints.
+#ifndef NO_DEBUG_OUTPUT
 #define DEBUG_PRINT_CODE
 #define DEBUG_TRACE_EXECUTION
+#endif
+
+// Per-opcode counters and cycle timing, enabled at runtime with --profile.
+// Off by default so the hooks stay out of the dispatch loop entirely.
+// #define PROFILE_OPCODES
 
 #endif
@@ -4,10 +4,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include "chunk.h"
 #include "common.h"
 #include "compiler.h"
+#include "list_kernels.h"
 #include "object.h"
 #include "tokenizer.h"
 #include "value.h"
@@ -32,7 +34,9 @@ typedef enum {
   PREC_PRIMARY
 } Precedence;
 
-typedef void (*ParseFn)(bool assignable);
+typedef struct Parser Parser;
+
+typedef void (*ParseFn)(Parser* parser, bool assignable);
 
 typedef struct {
     ParseFn prefix;
@@ -41,79 +45,131 @@ typedef struct {
 } ParseRule;
 
 
+#define LOCALS_MAX (U8_MAX + 1)
+#define BREAKS_MAX (U8_MAX + 1)
+
 typedef struct {
+    Token name;
+    i32 depth;  // -1 while the initializer is still being compiled
+} Local;
+
+typedef struct Loop {
+    struct Loop* enclosing;
+    u32 start;       // Where 'cycle' jumps back to
+    i32 scopeDepth;  // Locals deeper than this are popped on 'break'/'cycle'
+    u32 breakJumps[BREAKS_MAX];
+    u32 breakCount;
+} Loop;
+
+typedef enum {
+    TYPE_FUNCTION,
+    TYPE_SCRIPT,
+} FunctionType;
+
+// One per function being compiled. Locals live in VM stack slots relative
+// to the call frame; slot i holds locals[i] at runtime and slot 0 is the
+// callee itself.
+typedef struct Compiler {
+    struct Compiler* enclosing;
+    ObjFunction* function;
+    FunctionType type;
+
+    Local locals[LOCALS_MAX];
+    u32 localCount;
+    i32 scopeDepth;
+    Loop* loop;
+
+    // The last comparison emitted by compileBinary and the furthest forward
+    // jump target, so a branch can fuse with the comparison before it.
+    // Recorded sequences are never empty, so an end of 0 means there is
+    // none; after a syntax error the chunk itself can still be empty.
+    u32 compareStart;
+    u32 compareEnd;
+    TokenType compareOp;
+    u32 jumpTarget;
+    // Where the last OP_CALL starts and ends, for tail calls.
+    u32 callStart;
+    u32 callEnd;
+    // Where the last postfix '++'/'--' starts and ends; see discardResult.
+    u32 postfixStart;
+    u32 postfixEnd;
+} Compiler;
+
+// All compiler state lives here and is threaded through explicitly, so any
+// number of compilations can run at once, on any thread.
+struct Parser {
+    Tokenizer tokenizer;
     Token current;
     Token previous;
     bool hadError;
     bool panicMode;
-} Parser;
-
-static Parser parser;
-static Chunk* compilingChunk;
+    VM* vm;
+    Compiler* compiler;
+};
 
-// NOTE: This will be changed later
-static Chunk* currentChunk() {
-    return compilingChunk;
+static Chunk* currentChunk(Parser* parser) {
+    return &parser->compiler->function->chunk;
 }
 
-static void errorAt(const Token* token, const char* message) {
-    if (parser.panicMode) return;
-    parser.panicMode = true;
-    fprintf(stderr, "[line %d] Error", token->line);
+static void errorAt(Parser* parser, const Token* token, const char* message) {
+    if (parser->panicMode) return;
+    parser->panicMode = true;
+    FILE* err = parser->vm->err;
+    fprintf(err, "[line %d] Error", token->line);
 
     if (token->type == TOKEN_EOF) {
-        fprintf(stderr, " at end");
+        fprintf(err, " at end");
     } else if (token->type == TOKEN_ERROR) {
         // Nothing.
     } else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
+        fprintf(err, " at '%.*s'", token->length, token->start);
     }
 
-    fprintf(stderr, ": %s\n", message);
-    parser.hadError = true;
+    fprintf(err, ": %s\n", message);
+    parser->hadError = true;
 }
 
-static void error(const char* const message) {
-    errorAt(&parser.previous, message);
+static void error(Parser* parser, const char* const message) {
+    errorAt(parser, &parser->previous, message);
 }
 
-static void errorAtCurrent(const char* const message) {
-    errorAt(&parser.current, message);
+static void errorAtCurrent(Parser* parser, const char* const message) {
+    errorAt(parser, &parser->current, message);
 }
 
-static void advance() {
-    parser.previous = parser.current;
+static void advance(Parser* parser) {
+    parser->previous = parser->current;
     for ever {
-        parser.current = scanToken();
-        if (parser.current.type != TOKEN_ERROR) break;
+        parser->current = scanToken(&parser->tokenizer);
+        if (parser->current.type != TOKEN_ERROR) break;
 
-        errorAtCurrent(parser.current.start);
+        errorAtCurrent(parser, parser->current.start);
     }
 }
 
-static void consume(TokenType type, const char* message) {
-    if (parser.current.type == type) {
-        advance();
+static void consume(Parser* parser, TokenType type, const char* message) {
+    if (parser->current.type == type) {
+        advance(parser);
         return;
     }
 
-    errorAtCurrent(message);
+    errorAtCurrent(parser, message);
 }
 
-static bool tryConsume(TokenType type) {
-    if (parser.current.type == type) {
-        advance();
+static bool tryConsume(Parser* parser, TokenType type) {
+    if (parser->current.type == type) {
+        advance(parser);
         return true;
     }
 
     return false;
 }
 
-static bool peekIsOneOf(int count, ...) {
+static bool peekIsOneOf(Parser* parser, int count, ...) {
     va_list types;
     va_start(types, count);
 
-    TokenType peek = parser.current.type;
+    TokenType peek = parser->current.type;
     bool match = false;
     for (int i = 0; i < count; i++) {
         int tok = va_arg(types, int);
@@ -127,11 +183,11 @@ static bool peekIsOneOf(int count, ...) {
     return match;
 }
 
-static bool consumeOneOf(int count, ...) {
+static bool consumeOneOf(Parser* parser, int count, ...) {
     va_list types;
     va_start(types, count);
 
-    TokenType peek = parser.current.type;
+    TokenType peek = parser->current.type;
     bool match = false;
     for (int i = 0; i < count; i++) {
         int tok = va_arg(types, int);
@@ -142,70 +198,150 @@ static bool consumeOneOf(int count, ...) {
     }
 
     va_end(types);
-    advance();
+    advance(parser);
 
     return match;
 }
 
-static void emitByte(u8 byte) {
-    appendChunk(currentChunk(), byte, parser.previous.line);
+static void emitByte(Parser* parser, u8 byte) {
+    appendChunk(parser->vm, currentChunk(parser), byte,
+                parser->previous.line);
 }
 
-static void emitBytes(int count, ...) {
+static void emitBytes(Parser* parser, int count, ...) {
     va_list bytes;
     va_start(bytes, count);
 
     for (int i = 0; i < count; i++) {
         int byte = va_arg(bytes, int);
         assert(byte >= 0 && byte <= 255);
-        emitByte((u8)byte);
+        emitByte(parser, (u8)byte);
     }
 
     va_end(bytes);
 }
 
-static void emitReturn() {
-    emitByte(OP_RETURN);
+// Emits a jump with a placeholder offset; returns where to patch it.
+static u32 emitJump(Parser* parser, u8 instruction) {
+    emitBytes(parser, 3, instruction, 0xff, 0xff);
+    return currentChunk(parser)->count - 2;
+}
+
+static void patchJump(Parser* parser, u32 offset) {
+    Chunk* chunk = currentChunk(parser);
+    u32 jump = chunk->count - offset - 2;
+    if (jump > U16_MAX) {
+        error(parser, "Too much code to jump over.");
+    }
+
+    chunk->code[offset] = (jump >> 8) & 0xff;
+    chunk->code[offset+1] = jump & 0xff;
+    parser->compiler->jumpTarget = chunk->count;
+}
+
+static void emitLoop(Parser* parser, u32 loopStart) {
+    emitByte(parser, OP_LOOP);
+
+    u32 offset = currentChunk(parser)->count - loopStart + 2;
+    if (offset > U16_MAX) error(parser, "Loop body too large.");
+
+    emitBytes(parser, 2, (offset >> 8) & 0xff, offset & 0xff);
+}
+
+static void emitPops(Parser* parser, u32 count) {
+    if (count == 1) {
+        emitByte(parser, OP_POP);
+    } else if (count > 1) {
+        emitBytes(parser, 2, OP_POPN, count);
+    }
+}
+
+static void emitReturn(Parser* parser) {
+    emitBytes(parser, 2, OP_NIL, OP_RETURN);
 }
 
-static u8 makeConstant(Value value) {
-    u32 constIndex = addConstant(currentChunk(), value);
+static u8 makeConstant(Parser* parser, Value value) {
+    u32 constIndex = addConstant(parser->vm, currentChunk(parser), value);
     if (constIndex > U8_MAX) {
-        error("Too many constants in one chunk.");
+        error(parser, "Too many constants in one chunk.");
         return 0;
     }
 
     return (u8)constIndex;
 }
 
-static void emitConstant(Value value) {
-    emitBytes(2, OP_CONSTANT, makeConstant(value));
+static void emitConstant(Parser* parser, Value value) {
+    emitBytes(parser, 2, OP_CONSTANT, makeConstant(parser, value));
+}
+
+static void initCompiler(Parser* parser, Compiler* compiler,
+                         FunctionType type) {
+    compiler->enclosing = parser->compiler;
+    compiler->type = type;
+    compiler->localCount = 0;
+    compiler->scopeDepth = 0;
+    compiler->loop = NULL;
+    compiler->compareStart = 0;
+    compiler->compareEnd = 0;
+    compiler->compareOp = TOKEN_EOF;
+    compiler->jumpTarget = 0;
+    compiler->callStart = 0;
+    compiler->callEnd = 0;
+    compiler->postfixStart = 0;
+    compiler->postfixEnd = 0;
+    compiler->function = newFunction(parser->vm);
+    parser->compiler = compiler;
+
+    if (type != TYPE_SCRIPT) {
+        compiler->function->name = copyString(parser->vm,
+                                              parser->previous.start,
+                                              parser->previous.length);
+    }
+
+    // Slot 0 holds the function being called; it has no usable name.
+    Local* local = &compiler->locals[compiler->localCount++];
+    local->depth = 0;
+    local->name.start = "";
+    local->name.length = 0;
 }
 
-static void haltCompiler() {
-    emitReturn();
+static ObjFunction* endCompiler(Parser* parser) {
+    emitReturn(parser);
+    ObjFunction* function = parser->compiler->function;
 #ifdef DEBUG_PRINT_CODE
-    if (!parser.hadError) {
-        disassembleChunk(currentChunk(), "code");
+    if (!parser->hadError) {
+        disassembleChunk(parser->vm->out, currentChunk(parser),
+                         function->name != NULL ? function->name->chars
+                                                : "<script>");
     }
 #endif
+    parser->compiler = parser->compiler->enclosing;
+    return function;
 }
 
-static void compileDeclaration();
-static void compileVarDecl();
-static void compileStatement();
-static void compilePrintStmt();
-static void compileExprStmt();
-static void compileExpression();
+static void compileDeclaration(Parser* parser);
+static void compileVarDecl(Parser* parser);
+static void compileFunDecl(Parser* parser);
+static void compileStatement(Parser* parser);
+static void compileBlock(Parser* parser);
+static void compilePrintStmt(Parser* parser);
+static void compileReturnStmt(Parser* parser);
+static void compileIfStmt(Parser* parser);
+static void compileWhileStmt(Parser* parser);
+static void compileForStmt(Parser* parser);
+static void compileBreakStmt(Parser* parser);
+static void compileCycleStmt(Parser* parser);
+static void compileExprStmt(Parser* parser);
+static void compileExpression(Parser* parser);
 
 static ParseRule* getRule(TokenType type);
 
-static void synchronize() {
-    parser.panicMode = false;
+static void synchronize(Parser* parser) {
+    parser->panicMode = false;
 
-    for (;parser.current.type != TOKEN_EOF; advance()) {
-        if (parser.previous.type == TOKEN_SEMICOLON) return;
-        if (peekIsOneOf(8,
+    for (;parser->current.type != TOKEN_EOF; advance(parser)) {
+        if (parser->previous.type == TOKEN_SEMICOLON) return;
+        if (peekIsOneOf(parser, 8,
             TOKEN_CLASS, TOKEN_FUN, TOKEN_VAR,
             TOKEN_FOR, TOKEN_IF, TOKEN_WHILE,
             TOKEN_PRINT, TOKEN_RETURN)) {
@@ -214,115 +350,600 @@ static void synchronize() {
     }
 }
 
-static void parsePrecedence(Precedence precedence) {
-    advance();
-    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+static void parsePrecedence(Parser* parser, Precedence precedence) {
+    advance(parser);
+    ParseFn prefixRule = getRule(parser->previous.type)->prefix;
     if (prefixRule == NULL) {
-        error("Expect expression.");
+        error(parser, "Expect expression.");
         return;
     }
 
     bool assignable = precedence <= PREC_ASSIGNMENT;
-    prefixRule(assignable);
+    prefixRule(parser, assignable);
 
-    while (precedence <= getRule(parser.current.type)->precedence) {
-        advance();
-        ParseFn infixRule = getRule(parser.previous.type)->infix;
-        infixRule(assignable);
+    while (precedence <= getRule(parser->current.type)->precedence) {
+        advance(parser);
+        ParseFn infixRule = getRule(parser->previous.type)->infix;
+        infixRule(parser, assignable);
     }
 
-    if (assignable && tryConsume(TOKEN_EQUAL)) {
-        error("Invalid assignment target.");
+    if (assignable && peekIsOneOf(parser, 5, TOKEN_EQUAL, TOKEN_PLUS_EQUAL,
+                                  TOKEN_MINUS_EQUAL, TOKEN_STAR_EQUAL,
+                                  TOKEN_SLASH_EQUAL)) {
+        advance(parser);
+        error(parser, "Invalid assignment target.");
     }
-    // TODO: Add suffix rule for '++' and '--'
 }
 
-static u8 identifierConstant(Token* name) {
-    return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+static u8 identifierConstant(Parser* parser, Token* name) {
+    ObjString* string = copyString(parser->vm, name->start, name->length);
+    return makeConstant(parser, OBJ_VAL(string));
 }
 
-static u8 parseVariable(const char* errorMessage) {
-    consume(TOKEN_IDENTIFIER, errorMessage);
-    return identifierConstant(&parser.previous);
+static bool identifiersEqual(const Token* a, const Token* b) {
+    return a->length == b->length &&
+           memcmp(a->start, b->start, a->length) == 0;
 }
 
-static void defineVariable(u8 global) {
-    emitBytes(2, OP_DEFINE_GLOBAL, global);
+static i32 resolveLocal(Parser* parser, const Token* name) {
+    Compiler* compiler = parser->compiler;
+    for (i32 i = (i32)compiler->localCount - 1; i >= 0; i--) {
+        Local* local = &compiler->locals[i];
+        if (identifiersEqual(name, &local->name)) {
+            if (local->depth == -1) {
+                error(parser, "Can't read local variable in its own "
+                              "initializer.");
+            }
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void addLocal(Parser* parser, Token name) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->localCount == LOCALS_MAX) {
+        error(parser, "Too many local variables in scope.");
+        return;
+    }
+
+    Local* local = &compiler->locals[compiler->localCount++];
+    local->name = name;
+    local->depth = -1;
 }
 
-static void compileDeclaration() {
-    if (tryConsume(TOKEN_VAR)) {
-        compileVarDecl();
+static void declareVariable(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->scopeDepth == 0) return;
+
+    Token* name = &parser->previous;
+    for (i32 i = (i32)compiler->localCount - 1; i >= 0; i--) {
+        Local* local = &compiler->locals[i];
+        if (local->depth != -1 && local->depth < compiler->scopeDepth) break;
+
+        if (identifiersEqual(name, &local->name)) {
+            error(parser, "Already a variable with this name in this scope.");
+        }
+    }
+
+    addLocal(parser, *name);
+}
+
+static u8 parseVariable(Parser* parser, const char* errorMessage) {
+    consume(parser, TOKEN_IDENTIFIER, errorMessage);
+
+    declareVariable(parser);
+    if (parser->compiler->scopeDepth > 0) return 0;
+
+    return identifierConstant(parser, &parser->previous);
+}
+
+static void markInitialized(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->scopeDepth == 0) return;
+    compiler->locals[compiler->localCount - 1].depth = compiler->scopeDepth;
+}
+
+static void defineVariable(Parser* parser, u8 global) {
+    if (parser->compiler->scopeDepth > 0) {
+        // The value is already sitting in the local's stack slot.
+        markInitialized(parser);
+        return;
+    }
+
+    emitBytes(parser, 2, OP_DEFINE_GLOBAL, global);
+}
+
+static void beginScope(Parser* parser) {
+    parser->compiler->scopeDepth++;
+}
+
+static void endScope(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    compiler->scopeDepth--;
+
+    u32 popCount = 0;
+    while (compiler->localCount > 0 &&
+           compiler->locals[compiler->localCount - 1].depth >
+               compiler->scopeDepth) {
+        compiler->localCount--;
+        popCount++;
+    }
+
+    emitPops(parser, popCount);
+}
+
+// Number of stack slots held by locals declared inside the innermost loop.
+static u32 loopLocalCount(Compiler* compiler) {
+    u32 count = 0;
+    for (i32 i = (i32)compiler->localCount - 1; i >= 0; i--) {
+        if (compiler->locals[i].depth <= compiler->loop->scopeDepth) break;
+        count++;
+    }
+    return count;
+}
+
+static void beginLoop(Parser* parser, Loop* loop, u32 start) {
+    Compiler* compiler = parser->compiler;
+    loop->enclosing = compiler->loop;
+    loop->start = start;
+    loop->scopeDepth = compiler->scopeDepth;
+    loop->breakCount = 0;
+    compiler->loop = loop;
+}
+
+static void endLoop(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    Loop* loop = compiler->loop;
+    for (u32 i = 0; i < loop->breakCount; i++) {
+        patchJump(parser, loop->breakJumps[i]);
+    }
+    compiler->loop = loop->enclosing;
+}
+
+static u8 fusedBranchOp(TokenType compareOp) {
+    switch (compareOp) {
+        case TOKEN_LESS:          return OP_JUMP_IF_NOT_LESS;
+        case TOKEN_GREATER:       return OP_JUMP_IF_NOT_GREATER;
+        case TOKEN_GREATER_EQUAL: return OP_JUMP_IF_LESS;
+        case TOKEN_LESS_EQUAL:    return OP_JUMP_IF_GREATER;
+        case TOKEN_EQUAL_EQUAL:   return OP_JUMP_IF_NOT_EQUAL;
+        case TOKEN_BANG_EQUAL:    return OP_JUMP_IF_EQUAL;
+        default: return OP_JUMP_IF_FALSE; // Unreachable.
+    }
+}
+
+// Emits the jump taken when the condition on top of the stack is false.
+// A condition that ends in a comparison is fused into a single
+// compare-and-branch instruction, which leaves nothing on the stack;
+// otherwise the bool stays on the stack on both paths and *fused is false.
+static u32 emitBranch(Parser* parser, bool* fused) {
+    Compiler* compiler = parser->compiler;
+    Chunk* chunk = currentChunk(parser);
+    *fused = compiler->compareEnd > 0 &&
+             chunk->count == compiler->compareEnd &&
+             compiler->jumpTarget <= compiler->compareStart;
+    if (!*fused) return emitJump(parser, OP_JUMP_IF_FALSE);
+
+    truncateChunk(chunk, compiler->compareStart);
+    compiler->compareEnd = 0;
+    return emitJump(parser, fusedBranchOp(compiler->compareOp));
+}
+
+static void compileDeclaration(Parser* parser) {
+    if (tryConsume(parser, TOKEN_FUN)) {
+        compileFunDecl(parser);
+    } else if (tryConsume(parser, TOKEN_VAR)) {
+        compileVarDecl(parser);
     } else {
-        compileStatement();
+        compileStatement(parser);
     }
 
-    if (parser.panicMode) synchronize();
+    if (parser->panicMode) synchronize(parser);
 }
 
-static void compileVarDecl() {
-    u8 global = parseVariable("Expect variable name.");
+static void compileFunction(Parser* parser, FunctionType type) {
+    Compiler compiler;
+    initCompiler(parser, &compiler, type);
+    beginScope(parser);
+
+    consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+    if (!peekIsOneOf(parser, 1, TOKEN_RIGHT_PAREN)) {
+        do {
+            ObjFunction* function = compiler.function;
+            if (function->arity == U8_MAX) {
+                errorAtCurrent(parser, "Can't have more than 255 parameters.");
+            }
+            function->arity++;
+            u8 constant = parseVariable(parser, "Expect parameter name.");
+            defineVariable(parser, constant);
+        } while (tryConsume(parser, TOKEN_COMMA));
+    }
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(parser, TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+    compileBlock(parser);
+
+    // No endScope(): the callee's whole stack window is dropped on return.
+    ObjFunction* function = endCompiler(parser);
+    emitConstant(parser, OBJ_VAL(function));
+}
+
+static void compileFunDecl(Parser* parser) {
+    u8 global = parseVariable(parser, "Expect function name.");
+    // A function may refer to itself, so its name is usable right away.
+    markInitialized(parser);
+    compileFunction(parser, TYPE_FUNCTION);
+    defineVariable(parser, global);
+}
+
+static void compileVarDecl(Parser* parser) {
+    u8 global = parseVariable(parser, "Expect variable name.");
 
-    if (tryConsume(TOKEN_EQUAL)) {
-        compileExpression();
+    if (tryConsume(parser, TOKEN_EQUAL)) {
+        compileExpression(parser);
     } else {
-        emitByte(OP_NIL);
+        emitByte(parser, OP_NIL);
     }
 
-    consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+    consume(parser, TOKEN_SEMICOLON,
+            "Expect ';' after variable declaration.");
 
-    defineVariable(global);
+    defineVariable(parser, global);
 }
 
-static void compileStatement() {
-    if (tryConsume(TOKEN_PRINT)) {
-        compilePrintStmt();
+static void compileStatement(Parser* parser) {
+    if (tryConsume(parser, TOKEN_PRINT)) {
+        compilePrintStmt(parser);
+    } else if (tryConsume(parser, TOKEN_RETURN)) {
+        compileReturnStmt(parser);
+    } else if (tryConsume(parser, TOKEN_IF)) {
+        compileIfStmt(parser);
+    } else if (tryConsume(parser, TOKEN_WHILE)) {
+        compileWhileStmt(parser);
+    } else if (tryConsume(parser, TOKEN_FOR)) {
+        compileForStmt(parser);
+    } else if (tryConsume(parser, TOKEN_BREAK)) {
+        compileBreakStmt(parser);
+    } else if (tryConsume(parser, TOKEN_CYCLE)) {
+        compileCycleStmt(parser);
+    } else if (tryConsume(parser, TOKEN_LEFT_BRACE)) {
+        beginScope(parser);
+        compileBlock(parser);
+        endScope(parser);
     } else {
-        compileExprStmt();
+        compileExprStmt(parser);
     }
 }
 
-static void compilePrintStmt() {
-    compileExpression();
-    consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
-    emitByte(OP_PRINT);
+static void compileBlock(Parser* parser) {
+    while (!peekIsOneOf(parser, 2, TOKEN_RIGHT_BRACE, TOKEN_EOF)) {
+        compileDeclaration(parser);
+    }
+
+    consume(parser, TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+}
+
+static void compilePrintStmt(Parser* parser) {
+    compileExpression(parser);
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after expression.");
+    emitByte(parser, OP_PRINT);
 }
 
-static void compileExprStmt() {
-    compileExpression();
-    consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
-    emitByte(OP_POP);
+// Pops the value of an expression that was only run for its effect. When
+// that expression was a postfix update, its old value is never needed, so
+// the get/update/pop sequence collapses to the bare update.
+static void discardResult(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    Chunk* chunk = currentChunk(parser);
+    if (compiler->postfixEnd > 0 && chunk->count == compiler->postfixEnd &&
+        compiler->jumpTarget <= compiler->postfixStart) {
+        u8 update = chunk->code[compiler->postfixStart + 2];
+        u8 operand = chunk->code[compiler->postfixStart + 3];
+        truncateChunk(chunk, compiler->postfixStart);
+        compiler->postfixEnd = 0;
+        emitBytes(parser, 2, update, operand);
+    }
+    emitByte(parser, OP_POP);
 }
 
-static void compileExpression() {
-    parsePrecedence(PREC_ASSIGNMENT);
+static void compileReturnStmt(Parser* parser) {
+    if (parser->compiler->type == TYPE_SCRIPT) {
+        error(parser, "Can't return from top-level code.");
+    }
+
+    if (tryConsume(parser, TOKEN_SEMICOLON)) {
+        emitReturn(parser);
+        return;
+    }
+
+    compileExpression(parser);
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after return value.");
+
+    // A call whose result is returned as-is can reuse the current frame,
+    // unless some jump lands after it (e.g. the other arm of a ternary).
+    Compiler* compiler = parser->compiler;
+    Chunk* chunk = currentChunk(parser);
+    if (compiler->callEnd > 0 && chunk->count == compiler->callEnd &&
+        compiler->jumpTarget <= compiler->callStart) {
+        chunk->code[compiler->callStart] = OP_TAIL_CALL;
+    }
+    emitByte(parser, OP_RETURN);
+}
+
+static void compileIfStmt(Parser* parser) {
+    consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+    compileExpression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    bool fused;
+    u32 thenJump = emitBranch(parser, &fused);
+    if (!fused) emitByte(parser, OP_POP);
+    compileStatement(parser);
+
+    u32 elseJump = emitJump(parser, OP_JUMP);
+    patchJump(parser, thenJump);
+    if (!fused) emitByte(parser, OP_POP);
+
+    if (tryConsume(parser, TOKEN_ELSE)) compileStatement(parser);
+    patchJump(parser, elseJump);
 }
 
-static void compileBinary(bool _assignable) {
-    TokenType op = parser.previous.type;
+static void compileWhileStmt(Parser* parser) {
+    u32 loopStart = currentChunk(parser)->count;
+    consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+    compileExpression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    bool fused;
+    u32 exitJump = emitBranch(parser, &fused);
+    if (!fused) emitByte(parser, OP_POP);
+
+    Loop loop;
+    beginLoop(parser, &loop, loopStart);
+    compileStatement(parser);
+    emitLoop(parser, loopStart);
+
+    patchJump(parser, exitJump);
+    if (!fused) emitByte(parser, OP_POP);
+    endLoop(parser);
+}
+
+static void compileForStmt(Parser* parser) {
+    beginScope(parser);
+    consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+    if (tryConsume(parser, TOKEN_SEMICOLON)) {
+        // No initializer.
+    } else if (tryConsume(parser, TOKEN_VAR)) {
+        compileVarDecl(parser);
+    } else {
+        compileExprStmt(parser);
+    }
+
+    u32 loopStart = currentChunk(parser)->count;
+    bool hasCondition = false;
+    bool fused = false;
+    u32 exitJump = 0;
+    if (!tryConsume(parser, TOKEN_SEMICOLON)) {
+        compileExpression(parser);
+        consume(parser, TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+
+        hasCondition = true;
+        exitJump = emitBranch(parser, &fused);
+        if (!fused) emitByte(parser, OP_POP);
+    }
+
+    if (!tryConsume(parser, TOKEN_RIGHT_PAREN)) {
+        // The increment runs after the body, so jump over it on entry.
+        u32 bodyJump = emitJump(parser, OP_JUMP);
+        u32 incrementStart = currentChunk(parser)->count;
+        compileExpression(parser);
+        discardResult(parser);
+        consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+
+        emitLoop(parser, loopStart);
+        loopStart = incrementStart;
+        patchJump(parser, bodyJump);
+    }
+
+    Loop loop;
+    beginLoop(parser, &loop, loopStart);
+    compileStatement(parser);
+    emitLoop(parser, loopStart);
+
+    if (hasCondition) {
+        patchJump(parser, exitJump);
+        if (!fused) emitByte(parser, OP_POP);
+    }
+    endLoop(parser);
+    endScope(parser);
+}
+
+static void compileBreakStmt(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->loop == NULL) {
+        error(parser, "Can't use 'break' outside of a loop.");
+        return;
+    }
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after 'break'.");
+
+    Loop* loop = compiler->loop;
+    if (loop->breakCount == BREAKS_MAX) {
+        error(parser, "Too many 'break' statements in one loop.");
+        return;
+    }
+
+    emitPops(parser, loopLocalCount(compiler));
+    loop->breakJumps[loop->breakCount++] = emitJump(parser, OP_JUMP);
+}
+
+static void compileCycleStmt(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->loop == NULL) {
+        error(parser, "Can't use 'cycle' outside of a loop.");
+        return;
+    }
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after 'cycle'.");
+
+    emitPops(parser, loopLocalCount(compiler));
+    emitLoop(parser, compiler->loop->start);
+}
+
+static void compileExprStmt(Parser* parser) {
+    compileExpression(parser);
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after expression.");
+    discardResult(parser);
+}
+
+static void compileExpression(Parser* parser) {
+    parsePrecedence(parser, PREC_ASSIGNMENT);
+}
+
+static void compileBinary(Parser* parser, bool _assignable) {
+    TokenType op = parser->previous.type;
     ParseRule* rule = getRule(op);
-    parsePrecedence((Precedence)rule->precedence + 1);
+    parsePrecedence(parser, (Precedence)rule->precedence + 1);
 
+    u32 opStart = currentChunk(parser)->count;
     switch (op) {
-        case TOKEN_EQUAL_EQUAL:     emitByte(OP_EQUAL); break;
-        case TOKEN_BANG_EQUAL:      emitBytes(2, OP_EQUAL, OP_NOT); break;
-        case TOKEN_GREATER:         emitByte(OP_GREATER); break;
-        case TOKEN_GREATER_EQUAL:   emitBytes(2, OP_LESS, OP_NOT); break;
-        case TOKEN_LESS:            emitByte(OP_LESS); break;
-        case TOKEN_LESS_EQUAL:      emitBytes(2, OP_GREATER, OP_NOT); break;
-        case TOKEN_PLUS:            emitByte(OP_ADD); break;
-        case TOKEN_MINUS:           emitByte(OP_SUBTRACT); break;
-        case TOKEN_STAR:            emitByte(OP_MULTIPLY); break;
-        case TOKEN_SLASH:           emitByte(OP_DIVIDE); break;
+        case TOKEN_EQUAL_EQUAL:   emitByte(parser, OP_EQUAL); break;
+        case TOKEN_BANG_EQUAL:    emitBytes(parser, 2, OP_EQUAL, OP_NOT); break;
+        case TOKEN_GREATER:       emitByte(parser, OP_GREATER); break;
+        case TOKEN_GREATER_EQUAL: emitBytes(parser, 2, OP_LESS, OP_NOT); break;
+        case TOKEN_LESS:          emitByte(parser, OP_LESS); break;
+        case TOKEN_LESS_EQUAL:    emitBytes(parser, 2, OP_GREATER, OP_NOT); break;
+        case TOKEN_PLUS:          emitByte(parser, OP_ADD); break;
+        case TOKEN_MINUS:         emitByte(parser, OP_SUBTRACT); break;
+        case TOKEN_STAR:          emitByte(parser, OP_MULTIPLY); break;
+        case TOKEN_SLASH:         emitByte(parser, OP_DIVIDE); break;
         default: return; // Unreachable.
     }
+
+    if (rule->precedence == PREC_EQUALITY ||
+        rule->precedence == PREC_COMPARISON) {
+        Compiler* compiler = parser->compiler;
+        compiler->compareStart = opStart;
+        compiler->compareEnd = currentChunk(parser)->count;
+        compiler->compareOp = op;
+    }
+}
+
+static void compileAnd(Parser* parser, bool _assignable) {
+    u32 endJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    emitByte(parser, OP_POP);
+    parsePrecedence(parser, PREC_AND);
+    patchJump(parser, endJump);
+}
+
+static void compileOr(Parser* parser, bool _assignable) {
+    u32 elseJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    u32 endJump = emitJump(parser, OP_JUMP);
+
+    patchJump(parser, elseJump);
+    emitByte(parser, OP_POP);
+    parsePrecedence(parser, PREC_OR);
+    patchJump(parser, endJump);
+}
+
+static u8 compileArguments(Parser* parser) {
+    u8 argCount = 0;
+    if (!peekIsOneOf(parser, 1, TOKEN_RIGHT_PAREN)) {
+        do {
+            compileExpression(parser);
+            if (argCount == U8_MAX) {
+                error(parser, "Can't have more than 255 arguments.");
+            }
+            argCount++;
+        } while (tryConsume(parser, TOKEN_COMMA));
+    }
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+    return argCount;
+}
+
+static void compileCall(Parser* parser, bool _assignable) {
+    u8 argCount = compileArguments(parser);
+    Compiler* compiler = parser->compiler;
+    compiler->callStart = currentChunk(parser)->count;
+    emitBytes(parser, 2, OP_CALL, argCount);
+    compiler->callEnd = currentChunk(parser)->count;
+}
+
+static void compileList(Parser* parser, bool _assignable) {
+    u32 count = 0;
+    if (!peekIsOneOf(parser, 1, TOKEN_RIGHT_BRACKET)) {
+        do {
+            compileExpression(parser);
+            if (count == U8_MAX) {
+                error(parser, "Can't have more than 255 items in a list "
+                              "literal.");
+            }
+            count++;
+        } while (tryConsume(parser, TOKEN_COMMA));
+    }
+    consume(parser, TOKEN_RIGHT_BRACKET, "Expect ']' after list items.");
+    emitBytes(parser, 2, OP_BUILD_LIST, count & 0xff);
+}
+
+static void compileIndex(Parser* parser, bool assignable) {
+    compileExpression(parser);
+    consume(parser, TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+    if (assignable && tryConsume(parser, TOKEN_EQUAL)) {
+        compileExpression(parser);
+        emitByte(parser, OP_SET_INDEX);
+    } else {
+        emitByte(parser, OP_GET_INDEX);
+    }
+}
+
+static bool tokenIs(const Token* token, const char* text) {
+    return (usize)token->length == strlen(text) &&
+           memcmp(token->start, text, token->length) == 0;
+}
+
+// Compiles the parenthesized arguments of a list member call, which must
+// number exactly `arity`.
+static void compileMemberArgs(Parser* parser, u8 arity) {
+    consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after member name.");
+    u8 argCount = compileArguments(parser);
+    if (argCount != arity) {
+        error(parser, arity == 0 ? "Expect no arguments."
+                                 : "Expect one argument.");
+    }
+}
+
+// Lists are the only values with members for now: 'length', 'append' and
+// the bulk numeric kernels.
+static void compileDot(Parser* parser, bool _assignable) {
+    consume(parser, TOKEN_IDENTIFIER, "Expect member name after '.'.");
+    Token name = parser->previous;
+
+    if (tokenIs(&name, "length")) {
+        emitByte(parser, OP_LIST_LENGTH);
+        return;
+    }
+    if (tokenIs(&name, "append")) {
+        compileMemberArgs(parser, 1);
+        emitByte(parser, OP_LIST_APPEND);
+        return;
+    }
+
+    for (u32 kernel = 0; kernel < KERNEL_COUNT; kernel++) {
+        if (tokenIs(&name, listKernelName((ListKernel)kernel))) {
+            compileMemberArgs(parser, listKernelArity((ListKernel)kernel));
+            emitBytes(parser, 2, OP_LIST_KERNEL, kernel);
+            return;
+        }
+    }
+
+    error(parser, "Unknown list member.");
 }
 
-static void compileLiteral(bool _assignable) {
-    switch (parser.previous.type) {
-        case TOKEN_NIL:     emitByte(OP_NIL);   break;
-        case TOKEN_TRUE:    emitByte(OP_TRUE);  break;
-        case TOKEN_FALSE:   emitByte(OP_FALSE); break;
+static void compileLiteral(Parser* parser, bool _assignable) {
+    switch (parser->previous.type) {
+        case TOKEN_NIL:     emitByte(parser, OP_NIL);   break;
+        case TOKEN_TRUE:    emitByte(parser, OP_TRUE);  break;
+        case TOKEN_FALSE:   emitByte(parser, OP_FALSE); break;
         default: return; // Unreachable.
     }
 }
@@ -330,69 +951,184 @@ static void compileLiteral(bool _assignable) {
 // Notice that this doesn't directly emit any bytecode
 // That's by design! A grouping expression simply "upgrades" the precedance
 // of an expression, so it only changes the expression's location on the AST
-static void compileGrouping(bool _assignable) {
-    compileExpression();
-    consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+static void compileGrouping(Parser* parser, bool _assignable) {
+    compileExpression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+// Number literals are always `digits` or `digits.digits`. Integers that
+// fit in an i64 become VAL_INT. Otherwise, when there are at most 19
+// digits and their value fits in 2^53, both the mantissa and the power of
+// ten are exact doubles, so one division gives the correctly rounded
+// result. Anything longer goes to strtod.
+static Value parseNumber(const char* start, int length) {
+    static const f64 powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    u64 mantissa = 0;
+    i32 digits = 0;
+    i32 fractionDigits = -1;  // -1 until the point is seen
+    for (int i = 0; i < length; i++) {
+        if (start[i] == '.') {
+            fractionDigits = 0;
+            continue;
+        }
+        if (++digits > 19) return NUMBER_VAL(strtod(start, NULL));
+        mantissa = mantissa * 10 + (u64)(start[i] - '0');
+        if (fractionDigits >= 0) fractionDigits++;
+    }
+
+    if (fractionDigits < 0 && mantissa <= (u64)I64_MAX) {
+        return INT_VAL((i64)mantissa);
+    }
+    if (mantissa > (1ull << 53)) return NUMBER_VAL(strtod(start, NULL));
+    if (fractionDigits <= 0) return NUMBER_VAL((f64)mantissa);
+    return NUMBER_VAL((f64)mantissa / powersOf10[fractionDigits]);
+}
+
+static void compileNumber(Parser* parser, bool _assignable) {
+    emitConstant(parser, parseNumber(parser->previous.start,
+                                     parser->previous.length));
 }
 
-static void compileNumber(bool _assignable) {
-    f64 value = strtod(parser.previous.start, NULL);
-    emitConstant(NUMBER_VAL(value));
+static void compileString(Parser* parser, bool _assignable) {
+    emitConstant(parser, OBJ_VAL(copyString(parser->vm,
+                                            parser->previous.start+1,
+                                            parser->previous.length-2)));
 }
 
-static void compileString(bool _assignable) {
-    emitConstant(OBJ_VAL(copyString(parser.previous.start+1,
-                                    parser.previous.length-2)));
+static u8 arithmeticOp(TokenType compoundOp) {
+    switch (compoundOp) {
+        case TOKEN_PLUS_EQUAL:  return OP_ADD;
+        case TOKEN_MINUS_EQUAL: return OP_SUBTRACT;
+        case TOKEN_STAR_EQUAL:  return OP_MULTIPLY;
+        case TOKEN_SLASH_EQUAL: return OP_DIVIDE;
+        default: return OP_ADD; // Unreachable.
+    }
 }
 
-static void fetchNamedVariable(Token name, bool assignable) {
-    u8 arg = identifierConstant(&name);
-    if (assignable && tryConsume(TOKEN_EQUAL)) {
-        compileExpression();
-        emitBytes(2, OP_SET_GLOBAL, arg);
+static u8 globalUpdateOp(TokenType compoundOp) {
+    switch (compoundOp) {
+        case TOKEN_PLUS_EQUAL:  return OP_ADD_GLOBAL;
+        case TOKEN_MINUS_EQUAL: return OP_SUBTRACT_GLOBAL;
+        case TOKEN_STAR_EQUAL:  return OP_MULTIPLY_GLOBAL;
+        case TOKEN_SLASH_EQUAL: return OP_DIVIDE_GLOBAL;
+        default: return OP_ADD_GLOBAL; // Unreachable.
+    }
+}
+
+// The opcode that adds `delta` to a variable in place and pushes the result.
+static u8 stepOp(bool isLocal, bool increment) {
+    if (isLocal) return increment ? OP_INC_LOCAL : OP_DEC_LOCAL;
+    return increment ? OP_INC_GLOBAL : OP_DEC_GLOBAL;
+}
+
+static void fetchNamedVariable(Parser* parser, Token name, bool assignable) {
+    u8 getOp, setOp;
+    i32 arg = resolveLocal(parser, &name);
+    bool isLocal = arg != -1;
+    if (isLocal) {
+        getOp = OP_GET_LOCAL;
+        setOp = OP_SET_LOCAL;
     } else {
-        emitBytes(2, OP_GET_GLOBAL, arg);
+        arg = identifierConstant(parser, &name);
+        getOp = OP_GET_GLOBAL;
+        setOp = OP_SET_GLOBAL;
+    }
+
+    if (assignable && tryConsume(parser, TOKEN_EQUAL)) {
+        compileExpression(parser);
+        emitBytes(parser, 2, setOp, arg);
+    } else if (assignable && peekIsOneOf(parser, 4, TOKEN_PLUS_EQUAL,
+                                         TOKEN_MINUS_EQUAL, TOKEN_STAR_EQUAL,
+                                         TOKEN_SLASH_EQUAL)) {
+        TokenType op = parser->current.type;
+        advance(parser);
+        if (isLocal) {
+            // Stack slots are cheap to reach; only globals need fusing.
+            emitBytes(parser, 2, getOp, arg);
+            compileExpression(parser);
+            emitBytes(parser, 3, arithmeticOp(op), setOp, arg);
+        } else {
+            compileExpression(parser);
+            emitBytes(parser, 2, globalUpdateOp(op), arg);
+        }
+    } else if (peekIsOneOf(parser, 2, TOKEN_PLUS_PLUS, TOKEN_MINUS_MINUS)) {
+        // Postfix: the expression's value is the variable before the update.
+        bool increment = parser->current.type == TOKEN_PLUS_PLUS;
+        advance(parser);
+        Compiler* compiler = parser->compiler;
+        compiler->postfixStart = currentChunk(parser)->count;
+        emitBytes(parser, 2, getOp, arg);
+        emitBytes(parser, 2, stepOp(isLocal, increment), arg);
+        emitByte(parser, OP_POP);
+        compiler->postfixEnd = currentChunk(parser)->count;
+    } else {
+        emitBytes(parser, 2, getOp, arg);
     }
 }
 
-static void compileVariable(bool assignable) {
-    fetchNamedVariable(parser.previous, assignable);
+static void compileVariable(Parser* parser, bool assignable) {
+    fetchNamedVariable(parser, parser->previous, assignable);
 }
 
-static void compileUnary(bool _assignable) {
-    TokenType tok = parser.previous.type;
-    parsePrecedence(PREC_UNARY); // compile the operand
+static void compileUnary(Parser* parser, bool _assignable) {
+    TokenType tok = parser->previous.type;
+    parsePrecedence(parser, PREC_UNARY); // compile the operand
 
     switch (tok) {
-        case TOKEN_NOT: emitByte(OP_NOT); break;
-        case TOKEN_MINUS: emitByte(OP_NEGATE); break;
+        case TOKEN_NOT: emitByte(parser, OP_NOT); break;
+        case TOKEN_MINUS: emitByte(parser, OP_NEGATE); break;
         default: return; // unreachable
     }
 }
 
-static void compileTernary(bool _assignable) {
-    parsePrecedence(PREC_TERNARY - 1); // parse rhs of ?
-    consume(TOKEN_COLON, "Expect ':' in ternary expression.");
-    parsePrecedence(PREC_TERNARY - 1); // parse rhs of :
+static void compilePrefixStep(Parser* parser, bool _assignable) {
+    bool increment = parser->previous.type == TOKEN_PLUS_PLUS;
+    consume(parser, TOKEN_IDENTIFIER, increment
+            ? "Expect variable name after '++'."
+            : "Expect variable name after '--'.");
+
+    Token name = parser->previous;
+    i32 arg = resolveLocal(parser, &name);
+    bool isLocal = arg != -1;
+    if (!isLocal) arg = identifierConstant(parser, &name);
+    emitBytes(parser, 2, stepOp(isLocal, increment), arg);
+}
+
+static void compileTernary(Parser* parser, bool _assignable) {
+    bool fused;
+    u32 elseJump = emitBranch(parser, &fused);
+    if (!fused) emitByte(parser, OP_POP);
+    parsePrecedence(parser, PREC_TERNARY); // parse rhs of ?
+    consume(parser, TOKEN_COLON, "Expect ':' in ternary expression.");
+
+    u32 endJump = emitJump(parser, OP_JUMP);
+    patchJump(parser, elseJump);
+    if (!fused) emitByte(parser, OP_POP);
+    parsePrecedence(parser, PREC_TERNARY); // parse rhs of :
+    patchJump(parser, endJump);
 }
 
 ParseRule rules[] = {
-  [TOKEN_LEFT_PAREN]    = {compileGrouping, NULL,           PREC_NONE},
+  [TOKEN_LEFT_PAREN]    = {compileGrouping, compileCall,    PREC_CALL},
   [TOKEN_RIGHT_PAREN]   = {NULL,            NULL,           PREC_NONE},
-  [TOKEN_LEFT_BRACKET]  = {NULL,            NULL,           PREC_NONE}, 
+  [TOKEN_LEFT_BRACKET]  = {compileList,     compileIndex,   PREC_CALL},
   [TOKEN_RIGHT_BRACKET] = {NULL,            NULL,           PREC_NONE},
   [TOKEN_LEFT_BRACE]    = {NULL,            NULL,           PREC_NONE}, 
   [TOKEN_RIGHT_BRACE]   = {NULL,            NULL,           PREC_NONE},
   [TOKEN_SEMICOLON]     = {NULL,            NULL,           PREC_NONE},
   [TOKEN_COMMA]         = {NULL,            NULL,           PREC_NONE},
-  [TOKEN_DOT]           = {NULL,            NULL,           PREC_NONE},
+  [TOKEN_DOT]           = {NULL,            compileDot,     PREC_CALL},
   [TOKEN_MINUS]         = {compileUnary,    compileBinary,  PREC_TERM},
   [TOKEN_PLUS]          = {NULL,            compileBinary,  PREC_TERM},
   [TOKEN_SLASH]         = {NULL,            compileBinary,  PREC_FACTOR},
   [TOKEN_STAR]          = {NULL,            compileBinary,  PREC_FACTOR},
   [TOKEN_EQUAL]         = {NULL,            NULL,           PREC_NONE},
-  [TOKEN_MINUS_MINUS]   = {NULL,            NULL,           PREC_NONE},
-  [TOKEN_PLUS_PLUS]     = {NULL,            NULL,           PREC_NONE},
+  [TOKEN_MINUS_MINUS]   = {compilePrefixStep, NULL,         PREC_NONE},
+  [TOKEN_PLUS_PLUS]     = {compilePrefixStep, NULL,         PREC_NONE},
   [TOKEN_MINUS_EQUAL]   = {NULL,            NULL,           PREC_NONE},
   [TOKEN_PLUS_EQUAL]    = {NULL,            NULL,           PREC_NONE},
   [TOKEN_SLASH_EQUAL]   = {NULL,            NULL,           PREC_NONE},
@@ -406,8 +1142,8 @@ ParseRule rules[] = {
   [TOKEN_COLON]         = {NULL,            NULL,           PREC_NONE},
   [TOKEN_QUESTION_MARK] = {NULL,            compileTernary, PREC_TERNARY},
   [TOKEN_NOT]           = {compileUnary,    NULL,           PREC_NONE},
-  [TOKEN_AND]           = {NULL,            NULL,           PREC_NONE},
-  [TOKEN_OR]            = {NULL,            NULL,           PREC_NONE},
+  [TOKEN_AND]           = {NULL,            compileAnd,     PREC_AND},
+  [TOKEN_OR]            = {NULL,            compileOr,      PREC_OR},
   [TOKEN_NIL]           = {compileLiteral,  NULL,           PREC_NONE},
   [TOKEN_TRUE]          = {compileLiteral,  NULL,           PREC_NONE},
   [TOKEN_FALSE]         = {compileLiteral,  NULL,           PREC_NONE},
@@ -437,18 +1173,22 @@ static ParseRule* getRule(TokenType type) {
     return &rules[type];
 }
 
-bool compile(const char* source, Chunk* chunk) {
-    initTokenizer(source);
-    compilingChunk = chunk;
-
+ObjFunction* compile(VM* vm, const char* source) {
+    Parser parser;
+    initTokenizer(&parser.tokenizer, source);
+    parser.vm = vm;
+    parser.compiler = NULL;
     parser.hadError = false;
     parser.panicMode = false;
 
-    advance();
-    while (!tryConsume(TOKEN_EOF)) {
-        compileDeclaration();
+    Compiler compiler;
+    initCompiler(&parser, &compiler, TYPE_SCRIPT);
+
+    advance(&parser);
+    while (!tryConsume(&parser, TOKEN_EOF)) {
+        compileDeclaration(&parser);
     }
-    haltCompiler();
+    ObjFunction* function = endCompiler(&parser);
 
-    return !parser.hadError;
+    return parser.hadError ? NULL : function;
 }
@@ -5,6 +5,6 @@
 #include "object.h"
 #include "vm.h"
 
-bool compile(const char* source, Chunk* chunk);
+ObjFunction* compile(VM* vm, const char* source);
 
 #endif
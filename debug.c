@@ -4,78 +4,174 @@
 #include "chunk.h"
 #include "value.h"
 
-static u32 simpleInstruction(const char* name, u32 offset) {
-    printf("%s\n", name);
+static u32 simpleInstruction(FILE* out, const char* name, u32 offset) {
+    fprintf(out, "%s\n", name);
     return offset + 1;
 }
 
-void disassembleChunk(Chunk* chunk, const char* name) {
-    printf("== %s ==\n", name);
+const char* opcodeName(u8 instruction) {
+    switch (instruction) {
+        case OP_CONSTANT: return "OP_CONSTANT";
+        case OP_NIL: return "OP_NIL";
+        case OP_TRUE: return "OP_TRUE";
+        case OP_FALSE: return "OP_FALSE";
+        case OP_POP: return "OP_POP";
+        case OP_POPN: return "OP_POPN";
+        case OP_GET_LOCAL: return "OP_GET_LOCAL";
+        case OP_SET_LOCAL: return "OP_SET_LOCAL";
+        case OP_EQUAL: return "OP_EQUAL";
+        case OP_GET_GLOBAL: return "OP_GET_GLOBAL";
+        case OP_DEFINE_GLOBAL: return "OP_DEFINE_GLOBAL";
+        case OP_SET_GLOBAL: return "OP_SET_GLOBAL";
+        case OP_ADD_GLOBAL: return "OP_ADD_GLOBAL";
+        case OP_SUBTRACT_GLOBAL: return "OP_SUBTRACT_GLOBAL";
+        case OP_MULTIPLY_GLOBAL: return "OP_MULTIPLY_GLOBAL";
+        case OP_DIVIDE_GLOBAL: return "OP_DIVIDE_GLOBAL";
+        case OP_INC_GLOBAL: return "OP_INC_GLOBAL";
+        case OP_DEC_GLOBAL: return "OP_DEC_GLOBAL";
+        case OP_INC_LOCAL: return "OP_INC_LOCAL";
+        case OP_DEC_LOCAL: return "OP_DEC_LOCAL";
+        case OP_JUMP: return "OP_JUMP";
+        case OP_JUMP_IF_FALSE: return "OP_JUMP_IF_FALSE";
+        case OP_LOOP: return "OP_LOOP";
+        case OP_JUMP_IF_NOT_LESS: return "OP_JUMP_IF_NOT_LESS";
+        case OP_JUMP_IF_NOT_GREATER: return "OP_JUMP_IF_NOT_GREATER";
+        case OP_JUMP_IF_LESS: return "OP_JUMP_IF_LESS";
+        case OP_JUMP_IF_GREATER: return "OP_JUMP_IF_GREATER";
+        case OP_JUMP_IF_NOT_EQUAL: return "OP_JUMP_IF_NOT_EQUAL";
+        case OP_JUMP_IF_EQUAL: return "OP_JUMP_IF_EQUAL";
+        case OP_LESS: return "OP_LESS";
+        case OP_GREATER: return "OP_GREATER";
+        case OP_ADD: return "OP_ADD";
+        case OP_SUBTRACT: return "OP_SUBTRACT";
+        case OP_MULTIPLY: return "OP_MULTIPLY";
+        case OP_DIVIDE: return "OP_DIVIDE";
+        case OP_NOT: return "OP_NOT";
+        case OP_NEGATE: return "OP_NEGATE";
+        case OP_EQUAL_NUM: return "OP_EQUAL_NUM";
+        case OP_LESS_NUM: return "OP_LESS_NUM";
+        case OP_GREATER_NUM: return "OP_GREATER_NUM";
+        case OP_ADD_NUM: return "OP_ADD_NUM";
+        case OP_ADD_STR: return "OP_ADD_STR";
+        case OP_BUILD_LIST: return "OP_BUILD_LIST";
+        case OP_GET_INDEX: return "OP_GET_INDEX";
+        case OP_SET_INDEX: return "OP_SET_INDEX";
+        case OP_LIST_LENGTH: return "OP_LIST_LENGTH";
+        case OP_LIST_APPEND: return "OP_LIST_APPEND";
+        case OP_LIST_KERNEL: return "OP_LIST_KERNEL";
+        case OP_CALL: return "OP_CALL";
+        case OP_TAIL_CALL: return "OP_TAIL_CALL";
+        case OP_RETURN: return "OP_RETURN";
+        case OP_PRINT: return "OP_PRINT";
+        default: return NULL;
+    }
+}
+
+static u32 byteInstruction(FILE* out, const char* name, Chunk* chunk,
+                           u32 offset) {
+    u8 slot = chunk->code[offset+1];
+    fprintf(out, "%-16s %4d\n", name, slot);
+    return offset + 2;
+}
+
+static u32 jumpInstruction(FILE* out, const char* name, i32 sign,
+                           Chunk* chunk, u32 offset) {
+    u16 jump = (u16)(chunk->code[offset+1] << 8) | chunk->code[offset+2];
+    fprintf(out, "%-16s %4u -> %d\n", name, offset,
+            (i32)offset + 3 + sign * jump);
+    return offset + 3;
+}
+
+void disassembleChunk(FILE* out, Chunk* chunk, const char* name) {
+    fprintf(out, "== %s ==\n", name);
 
     for (u32 offset = 0; offset < chunk->count;) {
-        offset = disassembleInstruction(chunk, offset);
+        offset = disassembleInstruction(out, chunk, offset);
     }
 }
 
-static u32 constantInstruction(const char* name, Chunk* chunk, u32 offset) {
+static u32 constantInstruction(FILE* out, const char* name, Chunk* chunk,
+                               u32 offset) {
     u8 constant = chunk->code[offset+1];
-    printf("%-16s %4d '", name, constant);
-    printValue(chunk->constants.values[constant]);
-    printf("'\n");
+    fprintf(out, "%-16s %4d '", name, constant);
+    printValue(out, chunk->constants.values[constant]);
+    fprintf(out, "'\n");
     return offset + 2;
 }
 
-u32 disassembleInstruction(Chunk *chunk, u32 offset) {
-    printf("%04u ", offset);
+u32 disassembleInstruction(FILE* out, Chunk *chunk, u32 offset) {
+    fprintf(out, "%04u ", offset);
     if (offset > 0 && 
         getLine(&chunk->runTable, offset) == getLine(&chunk->runTable, offset-1)) {
-        printf("   | ");
+        fprintf(out, "   | ");
     } else {
-        printf("%4u ", getLine(&chunk->runTable, offset));
+        fprintf(out, "%4u ", getLine(&chunk->runTable, offset));
     }
 
     u8 instruction = chunk->code[offset];
     switch (instruction) {
         case OP_CONSTANT:
-            return constantInstruction("OP_CONSTANT", chunk, offset);
+        case OP_GET_GLOBAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_ADD_GLOBAL:
+        case OP_SUBTRACT_GLOBAL:
+        case OP_MULTIPLY_GLOBAL:
+        case OP_DIVIDE_GLOBAL:
+        case OP_INC_GLOBAL:
+        case OP_DEC_GLOBAL:
+            return constantInstruction(out, opcodeName(instruction), chunk,
+                                       offset);
+        case OP_POPN:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_INC_LOCAL:
+        case OP_DEC_LOCAL:
+        case OP_BUILD_LIST:
+        case OP_LIST_KERNEL:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            return byteInstruction(out, opcodeName(instruction), chunk, offset);
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL:
+            return jumpInstruction(out, opcodeName(instruction), 1, chunk,
+                                   offset);
+        case OP_LOOP:
+            return jumpInstruction(out, opcodeName(instruction), -1, chunk,
+                                   offset);
         case OP_NIL:
-            return simpleInstruction("OP_NIL", offset);
         case OP_TRUE:
-            return simpleInstruction("OP_TRUE", offset);
         case OP_FALSE:
-            return simpleInstruction("OP_FALSE", offset);
         case OP_POP:
-            return simpleInstruction("OP_POP", offset);
-        case OP_GET_GLOBAL:
-            return constantInstruction("OP_GET_GLOBAL", chunk, offset);
-        case OP_DEFINE_GLOBAL:
-            return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
-        case OP_SET_GLOBAL:
-            return constantInstruction("OP_SET_GLOBAL", chunk, offset);
         case OP_EQUAL:
-            return simpleInstruction("OP_EQUAL", offset);
         case OP_LESS:
-            return simpleInstruction("OP_LESS", offset);
         case OP_GREATER:
-            return simpleInstruction("OP_GREATER", offset);
         case OP_NEGATE:
-            return simpleInstruction("OP_NEGATE", offset);
         case OP_ADD:
-            return simpleInstruction("OP_ADD", offset);
         case OP_SUBTRACT:
-            return simpleInstruction("OP_SUBTRACT", offset);
         case OP_MULTIPLY:
-            return simpleInstruction("OP_MULTIPLY", offset);
         case OP_DIVIDE:
-            return simpleInstruction("OP_DIVIDE", offset);
         case OP_NOT:
-            return simpleInstruction("OP_NOT", offset);
+        case OP_GET_INDEX:
+        case OP_SET_INDEX:
+        case OP_LIST_LENGTH:
+        case OP_LIST_APPEND:
+        case OP_EQUAL_NUM:
+        case OP_LESS_NUM:
+        case OP_GREATER_NUM:
+        case OP_ADD_NUM:
+        case OP_ADD_STR:
         case OP_RETURN:
-            return simpleInstruction("OP_RETURN", offset);
         case OP_PRINT:
-            return simpleInstruction("OP_PRINT", offset);
+            return simpleInstruction(out, opcodeName(instruction), offset);
         default:
-            printf("Unknown opcode %d\n", instruction);
+            fprintf(out, "Unknown opcode %d\n", instruction);
             return offset + 1;
     }
 }
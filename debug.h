@@ -1,9 +1,12 @@
 #ifndef clox_debug_h
 #define clox_debug_h
 
+#include <stdio.h>
+
 #include "chunk.h"
 
-void disassembleChunk(Chunk* chunk, const char* name);
-u32 disassembleInstruction(Chunk* chunk, u32 offset);
+void disassembleChunk(FILE* out, Chunk* chunk, const char* name);
+u32 disassembleInstruction(FILE* out, Chunk* chunk, u32 offset);
+const char* opcodeName(u8 instruction);
 
 #endif
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "file.h"
+
+char* readFile(const char* path, FILE* err) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(err, "Could not open file \"%s\".\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    usize fileSize = ftell(file);
+    rewind(file);
+
+    char* buffer = (char*)malloc(fileSize + 1);
+    if (buffer == NULL) {
+        fprintf(err, "Not enough memory to read \"%s\".\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    usize bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    if (bytesRead < fileSize) {
+        fprintf(err, "Could not read file \"%s\".\n", path);
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    buffer[bytesRead] = '\0';
+
+    fclose(file);
+    return buffer;
+}
@@ -0,0 +1,10 @@
+#ifndef clox_file_h
+#define clox_file_h
+
+#include <stdio.h>
+
+// Reads the whole file into a NUL-terminated heap buffer the caller frees.
+// On failure the reason is written to err and NULL is returned.
+char* readFile(const char* path, FILE* err);
+
+#endif
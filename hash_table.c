@@ -14,8 +14,8 @@ void initHashTable(HashTable *table) {
     table->entries = NULL;
 }
 
-void freeHashTable(HashTable *table) {
-    FREE_ARRAY(Entry, table->entries, table->capacity);
+void freeHashTable(VM* vm, HashTable *table) {
+    FREE_ARRAY(vm, Entry, table->entries, table->capacity, MEM_HASH_TABLE);
     initHashTable(table);
 }
 
@@ -35,8 +35,8 @@ static Entry* findEntry(Entry* entries, u32 capacity, ObjString* key) {
     }
 }
 
-static void adjustCapacity(HashTable* table, u32 capacity) {
-    Entry* entries = ALLOCATE(Entry, capacity);
+static void adjustCapacity(VM* vm, HashTable* table, u32 capacity) {
+    Entry* entries = ALLOCATE(vm, Entry, capacity, MEM_HASH_TABLE);
     for (u32 i = 0; i < capacity; i++) {
         entries[i].key = NULL;
         entries[i].value = NIL_VAL;
@@ -53,7 +53,7 @@ static void adjustCapacity(HashTable* table, u32 capacity) {
         table->count++;
     }
 
-    FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(vm, Entry, table->entries, table->capacity, MEM_HASH_TABLE);
     table->entries = entries;
     table->capacity = capacity;
 }
@@ -72,10 +72,20 @@ GetResult hashTableGet(const HashTable* table, ObjString* key) {
     return result;
 }
 
-bool hashTableSet(HashTable* table, ObjString* key, Value value) {
+// The value's address, for updating it in place, or NULL if the key is
+// absent. Only valid until the next insertion into the table.
+Value* hashTableGetSlot(HashTable* table, ObjString* key) {
+    if (table->count == 0) return NULL;
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) return NULL;
+    return &entry->value;
+}
+
+bool hashTableSet(VM* vm, HashTable* table, ObjString* key, Value value) {
     if (table->count + 1 > table->capacity * HASHTABLE_MAX_LOAD) {
         u32 capacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, capacity);
+        adjustCapacity(vm, table, capacity);
     }
     Entry* entry = findEntry(table->entries, table->capacity, key);
     bool isNewKey = entry->key == NULL;
@@ -99,11 +109,11 @@ bool hashTableDelete(HashTable* table, ObjString* key) {
 }
 
 // Merge "from" into "to"
-void mergeHashTables(HashTable* from, HashTable* to) {
+void mergeHashTables(VM* vm, HashTable* from, HashTable* to) {
     for (u32 i = 0; i < from->capacity; i++) {
         Entry* entry = &from->entries[i];
         if (entry->key != NULL) {
-            hashTableSet(to, entry->key, entry->value);
+            hashTableSet(vm, to, entry->key, entry->value);
         }
     }
 }
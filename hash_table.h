@@ -5,7 +5,7 @@
 #include "value.h"
 
 typedef struct {
-    ObjString* key;
+    ObjString* key;  // a compile-time name, interned, so keys match by pointer
     Value value;
 } Entry;
 
@@ -21,11 +21,12 @@ typedef struct {
 } HashTable;
 
 void initHashTable(HashTable* table);
-void freeHashTable(HashTable* table);
+void freeHashTable(VM* vm, HashTable* table);
 GetResult hashTableGet(const HashTable* table, ObjString* key);
-bool hashTableSet(HashTable* table, ObjString* key, Value value);
+Value* hashTableGetSlot(HashTable* table, ObjString* key);
+bool hashTableSet(VM* vm, HashTable* table, ObjString* key, Value value);
 bool hashTableDelete(HashTable* table, ObjString* key);
-void mergeHashTables(HashTable* from, HashTable* to);
+void mergeHashTables(VM* vm, HashTable* from, HashTable* to);
 ObjString* hashTableFindString(HashTable* table, const char* chars,
                                u32 length, u32 hash);
 
@@ -0,0 +1,888 @@
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__x86_64__)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+#include "chunk.h"
+#include "hash_table.h"
+#include "jit.h"
+#include "memory.h"
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+#ifdef JIT_SUPPORTED
+
+// Slow paths called from machine code. They see the VM stack exactly as
+// the interpreter would, and return false after reporting a runtime error.
+
+static bool jitError(VM* vm, const char* message) {
+    runtimeError(vm, "%s", message);
+    return false;
+}
+
+// Mixed integer and double operands, and integer overflow, land here.
+static bool jitArithmetic(VM* vm, u8 instruction) {
+    Value b = peek(vm, 0);
+    Value a = peek(vm, 1);
+    if (!isNumber(a) || !isNumber(b)) {
+        return jitError(vm, "Operands must be numbers.");
+    }
+    vm->stackTop--;
+    switch (instruction) {
+        case OP_SUBTRACT: replaceTop(vm, numberSubtract(a, b)); break;
+        case OP_MULTIPLY: replaceTop(vm, numberMultiply(a, b)); break;
+        default:          replaceTop(vm, numberDivide(a, b)); break;
+    }
+    return true;
+}
+
+static bool jitAdd(VM* vm) {
+    Value b = peek(vm, 0);
+    Value a = peek(vm, 1);
+    if (isNumber(a) && isNumber(b)) {
+        vm->stackTop--;
+        replaceTop(vm, numberAdd(a, b));
+        return true;
+    }
+    if (!isObjType(a, OBJ_STRING) || !isObjType(b, OBJ_STRING)) {
+        return jitError(vm, "Operands must be two numbers or two strings.");
+    }
+    vm->stackTop--;
+    replaceTop(vm, OBJ_VAL(concatStrings(vm, stringFrom(a),
+                                         stringFrom(b))));
+    return true;
+}
+
+// Replaces both operands with the outcome of the interpreter's test for
+// `instruction`. A fused compare-jump branches when that comes out false.
+static bool jitCompare(VM* vm, u8 instruction) {
+    Value b = peek(vm, 0);
+    Value a = peek(vm, 1);
+    if (!isNumber(a) || !isNumber(b)) {
+        return jitError(vm, "Operands must be numbers.");
+    }
+    bool holds;
+    switch (instruction) {
+        case OP_LESS:
+        case OP_LESS_NUM:
+        case OP_JUMP_IF_NOT_LESS:    holds = numberLess(a, b); break;
+        case OP_GREATER:
+        case OP_GREATER_NUM:
+        case OP_JUMP_IF_NOT_GREATER: holds = numberGreater(a, b); break;
+        case OP_JUMP_IF_LESS:        holds = !numberLess(a, b); break;
+        default:                     holds = !numberGreater(a, b); break;
+    }
+    vm->stackTop--;
+    replaceTop(vm, BOOL_VAL(holds));
+    return true;
+}
+
+static bool jitNegate(VM* vm) {
+    if (!isNumber(top(vm))) {
+        return jitError(vm, "operand must be a number.");
+    }
+    replaceTop(vm, numberNegate(top(vm)));
+    return true;
+}
+
+static bool jitEqual(VM* vm) {
+    Value b = pop(vm);
+    replaceTop(vm, BOOL_VAL(valuesEqual(top(vm), b)));
+    return true;
+}
+
+// Pops both operands of a fused equality branch.
+static bool jitPopEqual(VM* vm) {
+    Value b = pop(vm);
+    Value a = pop(vm);
+    return valuesEqual(a, b);
+}
+
+static bool jitGetGlobal(VM* vm, ObjString* name) {
+    GetResult result = hashTableGet(&vm->globals, name);
+    if (!result.found) {
+        runtimeError(vm, "Undefined variable '%s'.", name->chars);
+        return false;
+    }
+    push(vm, result.value);
+    return true;
+}
+
+static bool jitDefineGlobal(VM* vm, ObjString* name) {
+    hashTableSet(vm, &vm->globals, name, pop(vm));
+    return true;
+}
+
+static bool jitSetGlobal(VM* vm, ObjString* name) {
+    if (hashTableSet(vm, &vm->globals, name, top(vm))) {
+        hashTableDelete(&vm->globals, name);
+        runtimeError(vm, "Undefined variable '%s'.", name->chars);
+        return false;
+    }
+    return true;
+}
+
+static bool jitStepGlobal(VM* vm, ObjString* name, bool decrement) {
+    Value* slot = hashTableGetSlot(&vm->globals, name);
+    if (slot == NULL) {
+        runtimeError(vm, "Undefined variable '%s'.", name->chars);
+        return false;
+    }
+    if (!isNumber(*slot)) {
+        return jitError(vm, "operand must be a number.");
+    }
+    *slot = numberAdd(*slot, INT_VAL(decrement ? -1 : 1));
+    push(vm, *slot);
+    return true;
+}
+
+// Updates the local in place; the machine code pushes it afterwards.
+static bool jitStepLocal(VM* vm, u8 slot, bool decrement) {
+    Value* local = &vm->frames[vm->frameCount - 1].slots[slot];
+    if (!isNumber(*local)) {
+        return jitError(vm, "operand must be a number.");
+    }
+    *local = numberAdd(*local, INT_VAL(decrement ? -1 : 1));
+    return true;
+}
+
+static bool jitPrint(VM* vm) {
+    writeValue(&vm->output, pop(vm));
+    writeChar(&vm->output, '\n');
+    return true;
+}
+
+// The templates keep VM state in callee-saved registers, so helper calls
+// only clobber scratch registers.
+enum {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+};
+#define VM_REG    RBX  // VM*
+#define TOP       R12  // vm->stackTop, written back around helper calls
+#define SLOTS     R13  // frame->slots
+#define FRAME     R14  // CallFrame*
+#define CONSTANTS R15  // chunk constants
+
+// Condition codes, as the low nibble of Jcc/SETcc.
+enum {
+    CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6,
+    CC_A = 0x7, CC_P = 0xa, CC_NP = 0xb, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe,
+    CC_G = 0xf, CC_ALWAYS = 0x10,
+};
+
+#define VALUE_SIZE ((i32)sizeof(Value))
+#define PAYLOAD    ((i32)offsetof(Value, as))
+// Displacement of the value `distance` slots below the stack top.
+#define PEEK(distance) (-VALUE_SIZE * ((distance) + 1))
+
+typedef struct {
+    u32 at;      // offset of a rel32 field
+    u32 target;  // bytecode offset, or one of the exit labels
+} JitPatch;
+
+typedef struct {
+    VM* vm;
+    Chunk* chunk;
+    u8* code;
+    u32 count;
+    u32 capacity;
+    u32* nativeAt;  // machine code offset of each bytecode offset
+    JitPatch* patches;
+    u32 patchCount;
+    u32 patchCapacity;
+    u32 offset;  // bytecode offset being compiled
+} Assembler;
+
+// Labels past the last bytecode offset.
+#define ERROR_EXIT(as) ((as)->chunk->count)
+#define EPILOGUE(as)   ((as)->chunk->count + 1)
+
+static void emitByte(Assembler* as, u8 byte) {
+    if (as->capacity < as->count + 1) {
+        u32 oldCapacity = as->capacity;
+        as->capacity = GROW_CAPACITY(oldCapacity);
+        as->code = GROW_ARRAY(as->vm, u8, as->code, oldCapacity,
+                              as->capacity, MEM_JIT_CODE);
+    }
+    as->code[as->count++] = byte;
+}
+
+static void emitBytes(Assembler* as, const u8* bytes, u32 count) {
+    for (u32 i = 0; i < count; i++) emitByte(as, bytes[i]);
+}
+
+static void emit32(Assembler* as, u32 value) {
+    for (u32 i = 0; i < 4; i++) emitByte(as, (u8)(value >> (8 * i)));
+}
+
+static void emit64(Assembler* as, u64 value) {
+    for (u32 i = 0; i < 8; i++) emitByte(as, (u8)(value >> (8 * i)));
+}
+
+static void emitRex(Assembler* as, bool wide, u8 reg, u8 base) {
+    u8 rex = 0x40 | wide << 3 | (reg >= 8) << 2 | (base >= 8);
+    if (rex != 0x40) emitByte(as, rex);
+}
+
+// ModRM, SIB and displacement for [base + disp].
+static void emitMem(Assembler* as, u8 reg, u8 base, i32 disp) {
+    bool short8 = disp >= -128 && disp <= 127;
+    emitByte(as, (short8 ? 0x40 : 0x80) | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP) emitByte(as, 0x24);
+    if (short8) {
+        emitByte(as, (u8)disp);
+    } else {
+        emit32(as, (u32)disp);
+    }
+}
+
+// op reg, [base + disp], with an optional mandatory prefix and 0F escape.
+static void emitOpMem(Assembler* as, u8 prefix, bool wide, bool escape,
+                      u8 op, u8 reg, u8 base, i32 disp) {
+    if (prefix != 0) emitByte(as, prefix);
+    emitRex(as, wide, reg, base);
+    if (escape) emitByte(as, 0x0f);
+    emitByte(as, op);
+    emitMem(as, reg, base, disp);
+}
+
+static void loadQ(Assembler* as, u8 reg, u8 base, i32 disp) {
+    emitOpMem(as, 0, true, false, 0x8b, reg, base, disp);
+}
+
+static void storeQ(Assembler* as, u8 base, i32 disp, u8 reg) {
+    emitOpMem(as, 0, true, false, 0x89, reg, base, disp);
+}
+
+static void loadD(Assembler* as, u8 reg, u8 base, i32 disp) {
+    emitOpMem(as, 0, false, false, 0x8b, reg, base, disp);
+}
+
+static void lea(Assembler* as, u8 reg, u8 base, i32 disp) {
+    emitOpMem(as, 0, true, false, 0x8d, reg, base, disp);
+}
+
+static void movImm64(Assembler* as, u8 reg, u64 value) {
+    emitRex(as, true, 0, reg);
+    emitByte(as, 0xb8 + (reg & 7));
+    emit64(as, value);
+}
+
+static void movReg(Assembler* as, u8 dst, u8 src) {
+    emitRex(as, true, src, dst);
+    emitByte(as, 0x89);
+    emitByte(as, 0xc0 | (src & 7) << 3 | (dst & 7));
+}
+
+static void addImm(Assembler* as, u8 reg, i32 value) {
+    emitRex(as, true, 0, reg);
+    emitByte(as, 0x81);
+    emitByte(as, 0xc0 | (reg & 7));
+    emit32(as, (u32)value);
+}
+
+// Stores a 32-bit immediate; `wide` sign-extends it to 64 bits.
+static void storeImm(Assembler* as, bool wide, u8 base, i32 disp, i32 value) {
+    emitOpMem(as, 0, wide, false, 0xc7, 0, base, disp);
+    emit32(as, (u32)value);
+}
+
+static void cmpType(Assembler* as, u8 base, i32 disp, ValueType type) {
+    emitOpMem(as, 0, false, false, 0x83, 7, base, disp);
+    emitByte(as, (u8)type);
+}
+
+// SSE2 op xmm, [base + disp] (or the store form for movdqu/movsd).
+static void sse(Assembler* as, u8 prefix, u8 op, u8 xmm, u8 base, i32 disp) {
+    emitOpMem(as, prefix, false, true, op, xmm, base, disp);
+}
+
+#define MOVDQU_LOAD  0xf3, 0x6f
+#define MOVDQU_STORE 0xf3, 0x7f
+#define MOVSD_LOAD   0xf2, 0x10
+#define MOVSD_STORE  0xf2, 0x11
+#define ADDSD        0xf2, 0x58
+#define MULSD        0xf2, 0x59
+#define SUBSD        0xf2, 0x5c
+#define DIVSD        0xf2, 0x5e
+#define UCOMISD      0x66, 0x2e
+
+// Integer op rax, [base + disp], as (0F escape, opcode).
+#define ADD_RM  false, 0x03
+#define SUB_RM  false, 0x2b
+#define IMUL_RM true, 0xaf
+#define NO_RM   false, 0x00  // no integer form
+
+// Returns the offset of the rel32 field, for patching.
+static u32 emitJump(Assembler* as, u8 cc) {
+    if (cc == CC_ALWAYS) {
+        emitByte(as, 0xe9);
+    } else {
+        emitByte(as, 0x0f);
+        emitByte(as, 0x80 | cc);
+    }
+    emit32(as, 0);
+    return as->count - 4;
+}
+
+static void patchHere(Assembler* as, u32 at) {
+    u32 rel = as->count - (at + 4);
+    memcpy(&as->code[at], &rel, sizeof(rel));
+}
+
+static void jumpTo(Assembler* as, u8 cc, u32 target) {
+    u32 at = emitJump(as, cc);
+    if (as->patchCapacity < as->patchCount + 1) {
+        u32 oldCapacity = as->patchCapacity;
+        as->patchCapacity = GROW_CAPACITY(oldCapacity);
+        as->patches = GROW_ARRAY(as->vm, JitPatch, as->patches, oldCapacity,
+                                 as->patchCapacity, MEM_JIT_CODE);
+    }
+    as->patches[as->patchCount++] = (JitPatch){ .at = at, .target = target };
+}
+
+#define HELPER(function) ((u64)(uintptr_t)(function))
+
+// Calls helper(vm, arg1, arg2) with the VM's view of the stack and of the
+// current instruction up to date, so the helper can report errors and see
+// its operands. Leaves the helper's result in al/eax.
+static void emitCall(Assembler* as, u64 helper, u64 arg1, u64 arg2) {
+    movImm64(as, RAX, (u64)(uintptr_t)(as->chunk->code + as->offset + 1));
+    storeQ(as, FRAME, offsetof(CallFrame, ip), RAX);
+    storeQ(as, VM_REG, offsetof(VM, stackTop), TOP);
+    movReg(as, RDI, VM_REG);
+    movImm64(as, RSI, arg1);
+    movImm64(as, RDX, arg2);
+    movImm64(as, RAX, helper);
+    emitBytes(as, (const u8[]){ 0xff, 0xd0 }, 2);  // call rax
+    loadQ(as, TOP, VM_REG, offsetof(VM, stackTop));
+}
+
+// Leaves the function if the helper just called returned false.
+static void emitCheck(Assembler* as) {
+    emitBytes(as, (const u8[]){ 0x84, 0xc0 }, 2);  // test al, al
+    jumpTo(as, CC_E, ERROR_EXIT(as));
+}
+
+static void emitError(Assembler* as, const char* message) {
+    emitCall(as, HELPER(jitError), (u64)(uintptr_t)message, 0);
+    jumpTo(as, CC_ALWAYS, ERROR_EXIT(as));
+}
+
+// Reports `message` unless the value has the given type.
+static void guardType(Assembler* as, u8 base, i32 disp, ValueType type,
+                      const char* message) {
+    cmpType(as, base, disp, type);
+    u32 ok = emitJump(as, CC_E);
+    emitError(as, message);
+    patchHere(as, ok);
+}
+
+// Sets ZF when the top two values both have the given type.
+static void testBoth(Assembler* as, ValueType type) {
+    loadD(as, RAX, TOP, PEEK(1));
+    loadD(as, RCX, TOP, PEEK(0));
+    emitByte(as, 0x35);  // xor eax, imm32
+    emit32(as, type);
+    emitBytes(as, (const u8[]){ 0x81, 0xf1 }, 2);  // xor ecx, imm32
+    emit32(as, type);
+    emitBytes(as, (const u8[]){ 0x09, 0xc8 }, 2);  // or eax, ecx
+}
+
+static void pushFrom(Assembler* as, u8 base, i32 disp) {
+    sse(as, MOVDQU_LOAD, 0, base, disp);
+    sse(as, MOVDQU_STORE, 0, TOP, 0);
+    addImm(as, TOP, VALUE_SIZE);
+}
+
+static void pushImmediate(Assembler* as, ValueType type, i32 payload) {
+    storeImm(as, false, TOP, 0, type);
+    storeImm(as, true, TOP, PAYLOAD, payload);
+    addImm(as, TOP, VALUE_SIZE);
+}
+
+// Two integers or two doubles inline; anything else, and integer overflow,
+// goes to `slow`, which handles it or reports the error.
+static void emitArithmetic(Assembler* as, u8 prefix, u8 op, bool intEscape,
+                           u8 intOp, u64 slow, u8 instruction) {
+    u32 overflow = 0;
+    u32 intDone = 0;
+    if (intOp != 0) {
+        testBoth(as, VAL_INT);
+        u32 notInts = emitJump(as, CC_NE);
+        loadQ(as, RAX, TOP, PEEK(1) + PAYLOAD);
+        emitOpMem(as, 0, true, intEscape, intOp, RAX, TOP, PEEK(0) + PAYLOAD);
+        overflow = emitJump(as, CC_O);
+        storeQ(as, TOP, PEEK(1) + PAYLOAD, RAX);
+        addImm(as, TOP, -VALUE_SIZE);
+        intDone = emitJump(as, CC_ALWAYS);
+        patchHere(as, notInts);
+    }
+
+    testBoth(as, VAL_NUMBER);
+    u32 notNumbers = emitJump(as, CC_NE);
+    sse(as, MOVSD_LOAD, 0, TOP, PEEK(1) + PAYLOAD);
+    sse(as, prefix, op, 0, TOP, PEEK(0) + PAYLOAD);
+    sse(as, MOVSD_STORE, 0, TOP, PEEK(1) + PAYLOAD);
+    addImm(as, TOP, -VALUE_SIZE);
+    u32 done = emitJump(as, CC_ALWAYS);
+
+    if (intOp != 0) patchHere(as, overflow);
+    patchHere(as, notNumbers);
+    emitCall(as, slow, instruction, 0);
+    emitCheck(as);
+    patchHere(as, done);
+    if (intOp != 0) patchHere(as, intDone);
+}
+
+// Sets the flags for the integer a - b, for the signed conditions.
+static void compareIntegers(Assembler* as) {
+    loadQ(as, RAX, TOP, PEEK(1) + PAYLOAD);
+    emitOpMem(as, 0, true, false, 0x3b, RAX, TOP, PEEK(0) + PAYLOAD);
+}
+
+// Loads one number operand into xmm0 and compares it with the other.
+// `swap` compares b with a, so every test can use the unsigned conditions,
+// which come out false on NaN.
+static void compareNumbers(Assembler* as, bool swap) {
+    sse(as, MOVSD_LOAD, 0, TOP, PEEK(swap ? 0 : 1) + PAYLOAD);
+    sse(as, UCOMISD, 0, TOP, PEEK(swap ? 1 : 0) + PAYLOAD);
+}
+
+static void setFlag(Assembler* as, u8 cc) {
+    emitBytes(as, (const u8[]){ 0x0f, 0x90 | cc, 0xc0 }, 3);  // setcc al
+}
+
+// `cc` tests doubles as compareNumbers leaves them, `intCc` integers.
+static void emitComparison(Assembler* as, u8 instruction, bool swap, u8 cc,
+                           u8 intCc) {
+    bool equality = instruction == OP_EQUAL || instruction == OP_EQUAL_NUM;
+    testBoth(as, VAL_INT);
+    u32 notInts = emitJump(as, CC_NE);
+    compareIntegers(as);
+    setFlag(as, intCc);
+    u32 compared = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notInts);
+    testBoth(as, VAL_NUMBER);
+    u32 notNumbers = emitJump(as, CC_NE);
+    compareNumbers(as, swap);
+    setFlag(as, cc);
+    if (equality) {
+        // Unordered also sets ZF; NaN is never equal.
+        emitBytes(as, (const u8[]){ 0x0f, 0x9b, 0xc1 }, 3);  // setnp cl
+        emitBytes(as, (const u8[]){ 0x20, 0xc8 }, 2);        // and al, cl
+    }
+    patchHere(as, compared);
+    emitBytes(as, (const u8[]){ 0x0f, 0xb6, 0xc0 }, 3);  // movzx eax, al
+    storeImm(as, false, TOP, PEEK(1), VAL_BOOL);
+    storeQ(as, TOP, PEEK(1) + PAYLOAD, RAX);
+    addImm(as, TOP, -VALUE_SIZE);
+    u32 done = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notNumbers);
+    emitCall(as, equality ? HELPER(jitEqual) : HELPER(jitCompare),
+             instruction, 0);
+    emitCheck(as);
+    patchHere(as, done);
+}
+
+// Fused compare-and-branch: pops both numbers and jumps on `cc`, or
+// `intCc` for two integers. Mixed operands go through jitCompare.
+static void emitCompareJump(Assembler* as, u8 instruction, bool swap, u8 cc,
+                            u8 intCc, u32 target) {
+    testBoth(as, VAL_INT);
+    u32 notInts = emitJump(as, CC_NE);
+    compareIntegers(as);
+    lea(as, TOP, TOP, PEEK(1));  // pops without touching the flags
+    jumpTo(as, intCc, target);
+    u32 intDone = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notInts);
+    testBoth(as, VAL_NUMBER);
+    u32 notNumbers = emitJump(as, CC_NE);
+    compareNumbers(as, swap);
+    lea(as, TOP, TOP, PEEK(1));
+    jumpTo(as, cc, target);
+    u32 done = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notNumbers);
+    emitCall(as, HELPER(jitCompare), instruction, 0);
+    emitCheck(as);
+    emitOpMem(as, 0, false, false, 0x80, 7, TOP, PEEK(0) + PAYLOAD);
+    emitByte(as, 0);  // cmp byte [top + payload], 0
+    lea(as, TOP, TOP, PEEK(0));
+    jumpTo(as, CC_E, target);
+    patchHere(as, done);
+    patchHere(as, intDone);
+}
+
+static void emitEqualJump(Assembler* as, bool jumpIfEqual, u32 target) {
+    testBoth(as, VAL_INT);
+    u32 notInts = emitJump(as, CC_NE);
+    compareIntegers(as);
+    lea(as, TOP, TOP, PEEK(1));
+    jumpTo(as, jumpIfEqual ? CC_E : CC_NE, target);
+    u32 intDone = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notInts);
+    testBoth(as, VAL_NUMBER);
+    u32 notNumbers = emitJump(as, CC_NE);
+    compareNumbers(as, false);
+    lea(as, TOP, TOP, PEEK(1));
+    if (jumpIfEqual) {
+        u32 differ = emitJump(as, CC_NE);
+        u32 unordered = emitJump(as, CC_P);
+        jumpTo(as, CC_ALWAYS, target);
+        patchHere(as, differ);
+        patchHere(as, unordered);
+    } else {
+        jumpTo(as, CC_NE, target);
+        jumpTo(as, CC_P, target);
+    }
+    u32 done = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notNumbers);
+    emitCall(as, HELPER(jitPopEqual), 0, 0);
+    emitBytes(as, (const u8[]){ 0x84, 0xc0 }, 2);  // test al, al
+    jumpTo(as, jumpIfEqual ? CC_NE : CC_E, target);
+    patchHere(as, done);
+    patchHere(as, intDone);
+}
+
+static void emitStepLocal(Assembler* as, u8 slot, i32 delta) {
+    i32 disp = VALUE_SIZE * slot;
+    cmpType(as, SLOTS, disp, VAL_INT);
+    u32 notInt = emitJump(as, CC_NE);
+    loadQ(as, RAX, SLOTS, disp + PAYLOAD);
+    addImm(as, RAX, delta);
+    u32 overflow = emitJump(as, CC_O);
+    storeQ(as, SLOTS, disp + PAYLOAD, RAX);
+    u32 intDone = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notInt);
+    cmpType(as, SLOTS, disp, VAL_NUMBER);
+    u32 notNumber = emitJump(as, CC_NE);
+    f64 step = delta;
+    u64 bits;
+    memcpy(&bits, &step, sizeof(bits));
+    sse(as, MOVSD_LOAD, 0, SLOTS, disp + PAYLOAD);
+    movImm64(as, RAX, bits);
+    emitBytes(as, (const u8[]){ 0x66, 0x48, 0x0f, 0x6e, 0xc8 }, 5);  // movq
+    emitBytes(as, (const u8[]){ 0xf2, 0x0f, 0x58, 0xc1 }, 4);  // addsd
+    sse(as, MOVSD_STORE, 0, SLOTS, disp + PAYLOAD);
+    u32 done = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, overflow);
+    patchHere(as, notNumber);
+    emitCall(as, HELPER(jitStepLocal), slot, delta < 0);
+    emitCheck(as);
+    patchHere(as, intDone);
+    patchHere(as, done);
+    pushFrom(as, SLOTS, disp);
+}
+
+// Doubles flip the sign bit inline; integers go through jitNegate, which
+// promotes the most negative one.
+static void emitNegate(Assembler* as) {
+    cmpType(as, TOP, PEEK(0), VAL_NUMBER);
+    u32 notNumber = emitJump(as, CC_NE);
+    movImm64(as, RAX, (u64)1 << 63);
+    emitOpMem(as, 0, true, false, 0x31, RAX, TOP, PEEK(0) + PAYLOAD);
+    u32 done = emitJump(as, CC_ALWAYS);
+
+    patchHere(as, notNumber);
+    emitCall(as, HELPER(jitNegate), 0, 0);
+    emitCheck(as);
+    patchHere(as, done);
+}
+
+static u32 jumpTarget(Chunk* chunk, u32 offset) {
+    u16 jump = (u16)(chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    if (chunk->code[offset] == OP_LOOP) return offset + 3 - jump;
+    return offset + 3 + jump;
+}
+
+static void emitPrologue(Assembler* as) {
+    static const u8 saves[] = {
+        0x55,              // push rbp
+        0x48, 0x89, 0xe5,  // mov rbp, rsp
+        0x53,              // push rbx
+        0x41, 0x54,        // push r12
+        0x41, 0x55,        // push r13
+        0x41, 0x56,        // push r14
+        0x41, 0x57,        // push r15
+        0x48, 0x83, 0xec, 0x08,  // sub rsp, 8: realigns calls to 16
+    };
+    emitBytes(as, saves, sizeof(saves));
+    movReg(as, VM_REG, RDI);
+    movReg(as, FRAME, RSI);
+    loadQ(as, SLOTS, FRAME, offsetof(CallFrame, slots));
+    loadQ(as, TOP, VM_REG, offsetof(VM, stackTop));
+    movImm64(as, CONSTANTS, (u64)(uintptr_t)as->chunk->constants.values);
+}
+
+static void emitExits(Assembler* as) {
+    as->nativeAt[ERROR_EXIT(as)] = as->count;
+    emitBytes(as, (const u8[]){ 0x31, 0xc0 }, 2);  // xor eax, eax
+    as->nativeAt[EPILOGUE(as)] = as->count;
+    static const u8 restores[] = {
+        0x48, 0x83, 0xc4, 0x08,  // add rsp, 8
+        0x41, 0x5f,  // pop r15
+        0x41, 0x5e,  // pop r14
+        0x41, 0x5d,  // pop r13
+        0x41, 0x5c,  // pop r12
+        0x5b,        // pop rbx
+        0x5d,        // pop rbp
+        0xc3,        // ret
+    };
+    emitBytes(as, restores, sizeof(restores));
+}
+
+// Emits the template for one instruction. Returns false for opcodes with
+// no template, which leave the whole function to the interpreter.
+static bool compileInstruction(Assembler* as) {
+    Chunk* chunk = as->chunk;
+    u32 offset = as->offset;
+    u8 instruction = chunk->code[offset];
+    u8 operand = chunk->code[offset + 1];
+
+    switch (instruction) {
+        case OP_CONSTANT: pushFrom(as, CONSTANTS, VALUE_SIZE * operand); break;
+        case OP_NIL:      pushImmediate(as, VAL_NIL, 0); break;
+        case OP_TRUE:     pushImmediate(as, VAL_BOOL, 1); break;
+        case OP_FALSE:    pushImmediate(as, VAL_BOOL, 0); break;
+        case OP_POP:      addImm(as, TOP, -VALUE_SIZE); break;
+        case OP_POPN:     addImm(as, TOP, -VALUE_SIZE * operand); break;
+        case OP_GET_LOCAL: pushFrom(as, SLOTS, VALUE_SIZE * operand); break;
+        case OP_SET_LOCAL:
+            sse(as, MOVDQU_LOAD, 0, TOP, PEEK(0));
+            sse(as, MOVDQU_STORE, 0, SLOTS, VALUE_SIZE * operand);
+            break;
+        case OP_GET_GLOBAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL: {
+            u64 helper = instruction == OP_GET_GLOBAL ? HELPER(jitGetGlobal)
+                       : instruction == OP_SET_GLOBAL ? HELPER(jitSetGlobal)
+                                                      : HELPER(jitDefineGlobal);
+            Obj* name = chunk->constants.values[operand].as.obj;
+            emitCall(as, helper, (u64)(uintptr_t)name, 0);
+            emitCheck(as);
+            break;
+        }
+        case OP_INC_GLOBAL:
+        case OP_DEC_GLOBAL: {
+            Obj* name = chunk->constants.values[operand].as.obj;
+            emitCall(as, HELPER(jitStepGlobal), (u64)(uintptr_t)name,
+                     instruction == OP_DEC_GLOBAL);
+            emitCheck(as);
+            break;
+        }
+        case OP_INC_LOCAL: emitStepLocal(as, operand, 1); break;
+        case OP_DEC_LOCAL: emitStepLocal(as, operand, -1); break;
+        case OP_JUMP:
+        case OP_LOOP:
+            jumpTo(as, CC_ALWAYS, jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_FALSE:
+            guardType(as, TOP, PEEK(0), VAL_BOOL,
+                      "Condition must be a boolean.");
+            emitOpMem(as, 0, false, false, 0x80, 7, TOP, PEEK(0) + PAYLOAD);
+            emitByte(as, 0);  // cmp byte [top + payload], 0
+            jumpTo(as, CC_E, jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_LESS:
+            emitCompareJump(as, instruction, true, CC_BE, CC_GE,
+                            jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_GREATER:
+            emitCompareJump(as, instruction, false, CC_BE, CC_LE,
+                            jumpTarget(chunk, offset));
+            break;
+        // CC_A is false on unordered, so NaN falls through like `!(a < b)`.
+        case OP_JUMP_IF_LESS:
+            emitCompareJump(as, instruction, true, CC_A, CC_L,
+                            jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_GREATER:
+            emitCompareJump(as, instruction, false, CC_A, CC_G,
+                            jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_EQUAL:
+            emitEqualJump(as, false, jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_EQUAL:
+            emitEqualJump(as, true, jumpTarget(chunk, offset));
+            break;
+        case OP_EQUAL:
+        case OP_EQUAL_NUM:
+            emitComparison(as, instruction, false, CC_E, CC_E);
+            break;
+        case OP_LESS:
+        case OP_LESS_NUM:
+            emitComparison(as, instruction, true, CC_A, CC_L);
+            break;
+        case OP_GREATER:
+        case OP_GREATER_NUM:
+            emitComparison(as, instruction, false, CC_A, CC_G);
+            break;
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_STR:
+            emitArithmetic(as, ADDSD, ADD_RM, HELPER(jitAdd), instruction);
+            break;
+        case OP_SUBTRACT:
+            emitArithmetic(as, SUBSD, SUB_RM, HELPER(jitArithmetic),
+                           instruction);
+            break;
+        case OP_MULTIPLY:
+            emitArithmetic(as, MULSD, IMUL_RM, HELPER(jitArithmetic),
+                           instruction);
+            break;
+        case OP_DIVIDE:
+            emitArithmetic(as, DIVSD, NO_RM, HELPER(jitArithmetic),
+                           instruction);
+            break;
+        case OP_NOT:
+            guardType(as, TOP, PEEK(0), VAL_BOOL, "operand must be a boolean.");
+            emitOpMem(as, 0, false, false, 0x80, 6, TOP, PEEK(0) + PAYLOAD);
+            emitByte(as, 1);  // xor byte [top + payload], 1
+            break;
+        case OP_NEGATE: emitNegate(as); break;
+        case OP_CALL:
+            emitCall(as, HELPER(callFromJit), operand, 0);
+            emitCheck(as);
+            break;
+        case OP_TAIL_CALL:
+            emitCall(as, HELPER(tailCallFromJit), operand, 0);
+            emitBytes(as, (const u8[]){ 0x85, 0xc0 }, 2);  // test eax, eax
+            jumpTo(as, CC_E, ERROR_EXIT(as));
+            emitBytes(as, (const u8[]){ 0x83, 0xf8, JIT_TAIL_CALL }, 3);
+            jumpTo(as, CC_E, EPILOGUE(as));
+            // A native callee already left its result for the return.
+            break;
+        case OP_RETURN:
+            sse(as, MOVDQU_LOAD, 0, TOP, PEEK(0));
+            sse(as, MOVDQU_STORE, 0, SLOTS, 0);
+            lea(as, TOP, SLOTS, VALUE_SIZE);
+            storeQ(as, VM_REG, offsetof(VM, stackTop), TOP);
+            emitByte(as, 0xb8);  // mov eax, imm32
+            emit32(as, JIT_RETURN);
+            jumpTo(as, CC_ALWAYS, EPILOGUE(as));
+            break;
+        case OP_PRINT:
+            emitCall(as, HELPER(jitPrint), 0, 0);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Copies the finished code into its own mapping, which is made executable
+// only once it can no longer be written.
+static JitCode* install(Assembler* as) {
+    void* memory = mmap(NULL, as->count, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return NULL;
+    memcpy(memory, as->code, as->count);
+    if (mprotect(memory, as->count, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, as->count);
+        return NULL;
+    }
+
+    JitCode* code = ALLOCATE(as->vm, JitCode, 1, MEM_JIT_CODE);
+    code->memory = memory;
+    code->size = as->count;
+    // ISO C has no object-to-function pointer cast; POSIX guarantees the
+    // representations match.
+    memcpy(&code->entry, &memory, sizeof(memory));
+    return code;
+}
+
+static JitCode* compileFunction(VM* vm, ObjFunction* function) {
+    Chunk* chunk = &function->chunk;
+    Assembler as;
+    as.vm = vm;
+    as.chunk = chunk;
+    as.code = NULL;
+    as.count = 0;
+    as.capacity = 0;
+    as.patches = NULL;
+    as.patchCount = 0;
+    as.patchCapacity = 0;
+    as.nativeAt = ALLOCATE(vm, u32, chunk->count + 2, MEM_JIT_CODE);
+
+    emitPrologue(&as);
+    bool supported = true;
+    for (u32 offset = 0; offset < chunk->count && supported;
+         offset += instructionLength(chunk->code[offset])) {
+        as.offset = offset;
+        as.nativeAt[offset] = as.count;
+        supported = compileInstruction(&as);
+    }
+
+    JitCode* code = NULL;
+    if (supported) {
+        emitExits(&as);
+        for (u32 i = 0; i < as.patchCount; i++) {
+            JitPatch* patch = &as.patches[i];
+            u32 rel = as.nativeAt[patch->target] - (patch->at + 4);
+            memcpy(&as.code[patch->at], &rel, sizeof(rel));
+        }
+        code = install(&as);
+    }
+
+    FREE_ARRAY(vm, u8, as.code, as.capacity, MEM_JIT_CODE);
+    FREE_ARRAY(vm, JitPatch, as.patches, as.patchCapacity, MEM_JIT_CODE);
+    FREE_ARRAY(vm, u32, as.nativeAt, chunk->count + 2, MEM_JIT_CODE);
+    return code;
+}
+
+bool jitAvailable(void) {
+    return true;
+}
+
+void jitCompile(VM* vm, ObjFunction* function) {
+    if (function->jit != NULL) return;
+    function->jit = compileFunction(vm, function);
+
+    // Functions are only created as constants of their enclosing chunk.
+    ValueArray* constants = &function->chunk.constants;
+    for (u32 i = 0; i < constants->count; i++) {
+        if (isObjType(constants->values[i], OBJ_FUNCTION)) {
+            jitCompile(vm, functionFrom(constants->values[i]));
+        }
+    }
+}
+
+void freeJitCode(VM* vm, JitCode* code) {
+    munmap(code->memory, code->size);
+    FREE(vm, JitCode, code, MEM_JIT_CODE);
+}
+
+#else
+
+bool jitAvailable(void) {
+    return false;
+}
+
+void jitCompile(VM* vm, ObjFunction* function) {
+    (void)vm;
+    (void)function;
+}
+
+void freeJitCode(VM* vm, JitCode* code) {
+    (void)vm;
+    (void)code;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef clox_jit_h
+#define clox_jit_h
+
+#include "common.h"
+#include "object.h"
+
+// Baseline template JIT (--jit). Each function's bytecode is stitched into
+// x86-64 machine code from one template per opcode, calling back into the
+// VM for slow paths. The machine code keeps the VM stack in exactly the
+// layout the interpreter uses, so compiled and interpreted frames call each
+// other freely, and a function with an opcode the JIT has no template for
+// simply stays interpreted.
+
+typedef enum {
+    JIT_ERROR,      // a runtime error was reported and the stack was reset
+    JIT_RETURN,     // the frame returned, leaving its result in slot 0
+    JIT_TAIL_CALL,  // the frame now holds a tail-called function to run
+} JitStatus;
+
+struct CallFrame;
+typedef JitStatus (*JitEntry)(VM* vm, struct CallFrame* frame);
+
+typedef struct JitCode {
+    JitEntry entry;
+    void* memory;  // executable mapping holding the code
+    usize size;
+} JitCode;
+
+// Whether this build targets a platform the JIT can generate code for.
+bool jitAvailable(void);
+// Compiles the function and every function nested in it that the JIT
+// supports. Functions it does not support keep jit == NULL.
+void jitCompile(VM* vm, ObjFunction* function);
+void freeJitCode(VM* vm, JitCode* code);
+
+#endif
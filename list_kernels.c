@@ -0,0 +1,169 @@
+#include "list_kernels.h"
+
+// The loops below work on four lanes at once with independent accumulators,
+// so there is no loop-carried dependency for an optimizing build to trip
+// over and the lanes map directly onto SIMD registers. Sums are therefore
+// reassociated and may differ from a left-to-right loop in the last bits.
+#define LANES 4
+
+const char* listKernelName(ListKernel kernel) {
+    switch (kernel) {
+        case KERNEL_SUM:   return "sum";
+        case KERNEL_MIN:   return "min";
+        case KERNEL_MAX:   return "max";
+        case KERNEL_DOT:   return "dot";
+        case KERNEL_ADD:   return "add";
+        case KERNEL_SCALE: return "scale";
+        default:           return NULL;
+    }
+}
+
+u32 listKernelArity(ListKernel kernel) {
+    switch (kernel) {
+        case KERNEL_DOT:
+        case KERNEL_ADD:
+        case KERNEL_SCALE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Only the tags are read, so this pass is cheap next to the kernel itself.
+// The lanes only look for doubles; the first integer drops to the scalar
+// loop for the rest of the list.
+u32 firstNonNumber(const Value* values, u32 count, bool* sawInteger) {
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        u32 mismatch = (values[i].type ^ VAL_NUMBER) |
+                       (values[i+1].type ^ VAL_NUMBER) |
+                       (values[i+2].type ^ VAL_NUMBER) |
+                       (values[i+3].type ^ VAL_NUMBER);
+        if (mismatch != 0) break;
+    }
+    for (; i < count; i++) {
+        if (values[i].type == VAL_INT) {
+            *sawInteger = true;
+        } else if (values[i].type != VAL_NUMBER) {
+            return i;
+        }
+    }
+    return count;
+}
+
+f64 sumNumbers(const Value* values, u32 count) {
+    f64 lane[LANES] = {0, 0, 0, 0};
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        lane[0] += values[i].as.number;
+        lane[1] += values[i+1].as.number;
+        lane[2] += values[i+2].as.number;
+        lane[3] += values[i+3].as.number;
+    }
+
+    f64 sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    for (; i < count; i++) sum += values[i].as.number;
+    return sum;
+}
+
+#define REDUCE_EXTREME(better) \
+    do { \
+        f64 lane[LANES]; \
+        for (u32 l = 0; l < LANES; l++) lane[l] = values[0].as.number; \
+        u32 i = 0; \
+        for (; i + LANES <= count; i += LANES) { \
+            for (u32 l = 0; l < LANES; l++) { \
+                f64 x = values[i+l].as.number; \
+                lane[l] = x better lane[l] ? x : lane[l]; \
+            } \
+        } \
+        f64 result = lane[0]; \
+        for (u32 l = 1; l < LANES; l++) { \
+            result = lane[l] better result ? lane[l] : result; \
+        } \
+        for (; i < count; i++) { \
+            f64 x = values[i].as.number; \
+            result = x better result ? x : result; \
+        } \
+        return result; \
+    } while (false)
+
+f64 minNumbers(const Value* values, u32 count) {
+    REDUCE_EXTREME(<);
+}
+
+f64 maxNumbers(const Value* values, u32 count) {
+    REDUCE_EXTREME(>);
+}
+
+#undef REDUCE_EXTREME
+
+f64 dotNumbers(const Value* a, const Value* b, u32 count) {
+    f64 lane[LANES] = {0, 0, 0, 0};
+    u32 i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        lane[0] += a[i].as.number * b[i].as.number;
+        lane[1] += a[i+1].as.number * b[i+1].as.number;
+        lane[2] += a[i+2].as.number * b[i+2].as.number;
+        lane[3] += a[i+3].as.number * b[i+3].as.number;
+    }
+
+    f64 dot = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    for (; i < count; i++) dot += a[i].as.number * b[i].as.number;
+    return dot;
+}
+
+void addNumbers(Value* out, const Value* a, const Value* b, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        out[i] = NUMBER_VAL(a[i].as.number + b[i].as.number);
+    }
+}
+
+void scaleNumbers(Value* out, const Value* values, f64 factor, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        out[i] = NUMBER_VAL(values[i].as.number * factor);
+    }
+}
+
+// With integers in play the kernels run the same number* operations a Lox
+// loop would, so integer results stay exact and overflow promotes.
+
+Value sumValues(const Value* values, u32 count) {
+    Value sum = INT_VAL(0);
+    for (u32 i = 0; i < count; i++) sum = numberAdd(sum, values[i]);
+    return sum;
+}
+
+Value minValue(const Value* values, u32 count) {
+    Value min = values[0];
+    for (u32 i = 1; i < count; i++) {
+        if (numberLess(values[i], min)) min = values[i];
+    }
+    return min;
+}
+
+Value maxValue(const Value* values, u32 count) {
+    Value max = values[0];
+    for (u32 i = 1; i < count; i++) {
+        if (numberGreater(values[i], max)) max = values[i];
+    }
+    return max;
+}
+
+Value dotValues(const Value* a, const Value* b, u32 count) {
+    Value dot = INT_VAL(0);
+    for (u32 i = 0; i < count; i++) {
+        dot = numberAdd(dot, numberMultiply(a[i], b[i]));
+    }
+    return dot;
+}
+
+void addValues(Value* out, const Value* a, const Value* b, u32 count) {
+    for (u32 i = 0; i < count; i++) out[i] = numberAdd(a[i], b[i]);
+}
+
+void scaleValues(Value* out, const Value* values, Value factor, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        out[i] = numberMultiply(values[i], factor);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef clox_list_kernels_h
+#define clox_list_kernels_h
+
+#include "common.h"
+#include "value.h"
+
+// Bulk numeric operations on list storage, called as list members.
+typedef enum {
+    KERNEL_SUM,
+    KERNEL_MIN,
+    KERNEL_MAX,
+    KERNEL_DOT,    // (other list)
+    KERNEL_ADD,    // (other list), element-wise into a new list
+    KERNEL_SCALE,  // (number), into a new list
+    KERNEL_COUNT,
+} ListKernel;
+
+const char* listKernelName(ListKernel kernel);
+u32 listKernelArity(ListKernel kernel);
+
+// Index of the first value that is not a number, or count if all are. Sets
+// *sawInteger if any of them is a VAL_INT. The kernels below assume this
+// already came back as count.
+u32 firstNonNumber(const Value* values, u32 count, bool* sawInteger);
+
+// For lists of doubles only.
+f64 sumNumbers(const Value* values, u32 count);
+f64 minNumbers(const Value* values, u32 count);  // count > 0
+f64 maxNumbers(const Value* values, u32 count);  // count > 0
+f64 dotNumbers(const Value* a, const Value* b, u32 count);
+void addNumbers(Value* out, const Value* a, const Value* b, u32 count);
+void scaleNumbers(Value* out, const Value* values, f64 factor, u32 count);
+
+// For lists with integers in them.
+Value sumValues(const Value* values, u32 count);
+Value minValue(const Value* values, u32 count);  // count > 0
+Value maxValue(const Value* values, u32 count);  // count > 0
+Value dotValues(const Value* a, const Value* b, u32 count);
+void addValues(Value* out, const Value* a, const Value* b, u32 count);
+void scaleValues(Value* out, const Value* values, Value factor, u32 count);
+
+#endif
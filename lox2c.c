@@ -0,0 +1,691 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "chunk.h"
+#include "list_kernels.h"
+#include "lox2c.h"
+#include "memory.h"
+#include "run_table.h"
+#include "vm.h"
+
+typedef struct {
+    ObjFunction** functions;  // [0] is the script
+    u32 count;
+    u32 capacity;
+} FunctionList;
+
+// Per-function state. The operand stack depth is known at every
+// instruction, so stack position i becomes the C local s<i>, and locals are
+// simply the positions the compiler gave them.
+typedef struct {
+    VM* vm;
+    FILE* body;
+    ObjFunction* function;
+    u32 index;
+    Chunk* chunk;
+    u32 depth;
+    u32 maxDepth;
+    bool* isTarget;
+    i32* depthAt;  // depth at each jump target from reachable jumps, or -1
+    u8* uses;      // POSITION_READ | POSITION_WRITTEN for each position
+    u32 line;      // source line of the instruction being emitted
+    bool selfTailCall;
+    bool failed;
+} Emitter;
+
+static void appendFunction(VM* vm, FunctionList* list, ObjFunction* function) {
+    if (list->capacity < list->count + 1) {
+        u32 oldCapacity = list->capacity;
+        list->capacity = GROW_CAPACITY(oldCapacity);
+        list->functions = GROW_ARRAY(vm, ObjFunction*, list->functions,
+                                     oldCapacity, list->capacity,
+                                     MEM_FUNCTION_OBJ);
+    }
+    list->functions[list->count++] = function;
+
+    // Functions are only created as constants of their enclosing chunk.
+    ValueArray* constants = &function->chunk.constants;
+    for (u32 i = 0; i < constants->count; i++) {
+        if (isObjType(constants->values[i], OBJ_FUNCTION)) {
+            appendFunction(vm, list, functionFrom(constants->values[i]));
+        }
+    }
+}
+
+static u32 functionIndex(const FunctionList* list, ObjFunction* function) {
+    for (u32 i = 0; i < list->count; i++) {
+        if (list->functions[i] == function) return i;
+    }
+    return 0;
+}
+
+static void printEntryName(FILE* out, const FunctionList* list, u32 index) {
+    if (index == 0) {
+        fputs("script", out);
+    } else {
+        fprintf(out, "fn%u_%s", index, list->functions[index]->name->chars);
+    }
+}
+
+static void printCString(FILE* out, const char* chars, u32 length) {
+    fputc('"', out);
+    for (u32 i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c == '\n') {
+            fputs("\\n", out);
+        } else if (c < ' ' || c >= 0x7f) {
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// One statement of the function body.
+static void emit(Emitter* e, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fputs("    ", e->body);
+    vfprintf(e->body, format, args);
+    fputc('\n', e->body);
+    va_end(args);
+}
+
+// The aotError() call that ends a failing function; `message` is NULL when
+// a runtime helper already reported the error.
+static void emitFail(Emitter* e, const char* condition, const char* message) {
+    fprintf(e->body, "    if (%s) return aotError(vm, %u, ", condition,
+            e->line);
+    if (e->index == 0) {
+        fputs("NULL, ", e->body);
+    } else {
+        fprintf(e->body, "\"%s\", ", e->function->name->chars);
+    }
+    if (message == NULL) {
+        fputs("NULL);\n", e->body);
+    } else {
+        fprintf(e->body, "\"%s\");\n", message);
+    }
+}
+
+static u32 pushPosition(Emitter* e) {
+    u32 position = e->depth++;
+    if (e->depth > e->maxDepth) e->maxDepth = e->depth;
+    return position;
+}
+
+static u32 popPosition(Emitter* e) {
+    return --e->depth;
+}
+
+static u32 topPosition(Emitter* e) {
+    return e->depth - 1;
+}
+
+#define POSITION_READ    1
+#define POSITION_WRITTEN 2
+
+// Mark how the generated code uses the local s<position>. Locals it never
+// mentions aren't declared, and ones it only stores to are cast to void,
+// so the output compiles cleanly with -Wall -Wextra.
+static u32 reads(Emitter* e, u32 position) {
+    e->uses[position] |= POSITION_READ;
+    return position;
+}
+
+static u32 writes(Emitter* e, u32 position) {
+    e->uses[position] |= POSITION_WRITTEN;
+    return position;
+}
+
+static u8 operand(Emitter* e, u32 offset) {
+    return e->chunk->code[offset + 1];
+}
+
+static u32 jumpTarget(Chunk* chunk, u32 offset) {
+    u16 jump = (u16)(chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    if (chunk->code[offset] == OP_LOOP) return offset + 3 - jump;
+    return offset + 3 + jump;
+}
+
+static void emitGoto(Emitter* e, const char* condition, u32 target) {
+    if (condition == NULL) {
+        emit(e, "goto L%u;", target);
+    } else {
+        emit(e, "if (%s) goto L%u;", condition, target);
+    }
+    if (e->depthAt[target] < 0) e->depthAt[target] = (i32)e->depth;
+}
+
+static void emitNumberCheck(Emitter* e, u32 a, u32 b) {
+    char condition[48];
+    snprintf(condition, sizeof(condition), "!isNumber(s%u) || !isNumber(s%u)",
+             reads(e, a), reads(e, b));
+    emitFail(e, condition, "Operands must be numbers.");
+}
+
+static void emitArithmetic(Emitter* e, const char* helper) {
+    u32 b = popPosition(e);
+    u32 a = topPosition(e);
+    emitNumberCheck(e, a, b);
+    emit(e, "s%u = %s(s%u, s%u);", writes(e, a), helper, reads(e, a),
+         reads(e, b));
+}
+
+static void emitComparison(Emitter* e, const char* helper) {
+    u32 b = popPosition(e);
+    u32 a = topPosition(e);
+    emitNumberCheck(e, a, b);
+    emit(e, "s%u = BOOL_VAL(%s(s%u, s%u));", writes(e, a), helper,
+         reads(e, a), reads(e, b));
+}
+
+static void emitCompareJump(Emitter* e, const char* helper, bool jumpWhen,
+                            u32 target) {
+    u32 b = popPosition(e);
+    u32 a = popPosition(e);
+    emitNumberCheck(e, a, b);
+    char condition[64];
+    snprintf(condition, sizeof(condition), "%s%s(s%u, s%u)",
+             jumpWhen ? "" : "!", helper, reads(e, a), reads(e, b));
+    emitGoto(e, condition, target);
+}
+
+static void emitCall(Emitter* e, u8 argCount, bool tail) {
+    u32 base = e->depth - argCount - 1;
+    ObjFunction* function = e->function;
+
+    if (tail && e->index != 0 && argCount == function->arity) {
+        // Tail calls to the function itself become a jump back to the top.
+        fprintf(e->body, "    if (isObjType(s%u, OBJ_FUNCTION) && "
+                         "functionFrom(s%u) == functions[%u]) {\n",
+                reads(e, base), base, e->index);
+        for (u32 i = 1; i <= argCount; i++) {
+            fprintf(e->body, "        s%u = s%u;\n", writes(e, i),
+                    reads(e, base + i));
+        }
+        fputs("        goto start;\n    }\n", e->body);
+        e->selfTailCall = true;
+    }
+
+    fprintf(e->body, "    { Value call[] = {");
+    for (u32 i = 0; i <= argCount; i++) {
+        fprintf(e->body, "%s s%u", i == 0 ? "" : ",", reads(e, base + i));
+    }
+    fprintf(e->body, " };\n  ");
+    if (tail) {
+        fprintf(e->body, "    AotCallStatus status = aotTailCall(vm, &program, "
+                         "call, %u, &s%u);\n", argCount, writes(e, base));
+        fputs("      if (status == AOT_CALL_STAGED) return AOT_TAIL_CALL;\n  ",
+              e->body);
+        emitFail(e, "status == AOT_CALL_FAILED", NULL);
+    } else {
+        char condition[64];
+        snprintf(condition, sizeof(condition),
+                 "!aotCall(vm, &program, depth, call, %u, &s%u)", argCount,
+                 writes(e, base));
+        emitFail(e, condition, NULL);
+    }
+    emit(e, "}");
+    e->depth = base + 1;
+}
+
+// Emits one instruction. Returns false if control never falls through to
+// the next one.
+static bool emitInstruction(Emitter* e, u32 offset) {
+    u8 instruction = e->chunk->code[offset];
+    char condition[96];
+
+    switch (instruction) {
+        case OP_CONSTANT:
+            emit(e, "s%u = k%u[%u];", writes(e, pushPosition(e)), e->index,
+                 operand(e, offset));
+            break;
+        case OP_NIL:
+            emit(e, "s%u = NIL_VAL;", writes(e, pushPosition(e)));
+            break;
+        case OP_TRUE:
+            emit(e, "s%u = BOOL_VAL(true);", writes(e, pushPosition(e)));
+            break;
+        case OP_FALSE:
+            emit(e, "s%u = BOOL_VAL(false);", writes(e, pushPosition(e)));
+            break;
+        case OP_POP:   popPosition(e); break;
+        case OP_POPN:  e->depth -= operand(e, offset); break;
+        case OP_GET_LOCAL:
+            emit(e, "s%u = s%u;", writes(e, pushPosition(e)),
+                 reads(e, operand(e, offset)));
+            break;
+        case OP_SET_LOCAL:
+            emit(e, "s%u = s%u;", writes(e, operand(e, offset)),
+                 reads(e, topPosition(e)));
+            break;
+        case OP_GET_GLOBAL:
+            snprintf(condition, sizeof(condition),
+                     "!aotGetGlobal(vm, k%u[%u], &s%u)", e->index,
+                     operand(e, offset), writes(e, pushPosition(e)));
+            emitFail(e, condition, NULL);
+            break;
+        case OP_DEFINE_GLOBAL:
+            emit(e, "aotDefineGlobal(vm, k%u[%u], s%u);", e->index,
+                 operand(e, offset), reads(e, popPosition(e)));
+            break;
+        case OP_SET_GLOBAL:
+            snprintf(condition, sizeof(condition),
+                     "!aotSetGlobal(vm, k%u[%u], s%u)", e->index,
+                     operand(e, offset), reads(e, topPosition(e)));
+            emitFail(e, condition, NULL);
+            break;
+        case OP_ADD_GLOBAL:
+        case OP_SUBTRACT_GLOBAL:
+        case OP_MULTIPLY_GLOBAL:
+        case OP_DIVIDE_GLOBAL: {
+            const char* op = instruction == OP_ADD_GLOBAL ? "OP_ADD"
+                           : instruction == OP_SUBTRACT_GLOBAL ? "OP_SUBTRACT"
+                           : instruction == OP_MULTIPLY_GLOBAL ? "OP_MULTIPLY"
+                                                               : "OP_DIVIDE";
+            snprintf(condition, sizeof(condition),
+                     "!aotUpdateGlobal(vm, k%u[%u], %s, s%u, &s%u)",
+                     e->index, operand(e, offset), op,
+                     reads(e, topPosition(e)), writes(e, topPosition(e)));
+            emitFail(e, condition, NULL);
+            break;
+        }
+        case OP_INC_GLOBAL:
+        case OP_DEC_GLOBAL:
+            snprintf(condition, sizeof(condition),
+                     "!aotStepGlobal(vm, k%u[%u], %d, &s%u)", e->index,
+                     operand(e, offset), instruction == OP_INC_GLOBAL ? 1 : -1,
+                     writes(e, pushPosition(e)));
+            emitFail(e, condition, NULL);
+            break;
+        case OP_INC_LOCAL:
+        case OP_DEC_LOCAL: {
+            u8 slot = operand(e, offset);
+            snprintf(condition, sizeof(condition), "!isNumber(s%u)",
+                     reads(e, slot));
+            emitFail(e, condition, "operand must be a number.");
+            emit(e, "s%u = numberAdd(s%u, INT_VAL(%d));", writes(e, slot),
+                 slot, instruction == OP_INC_LOCAL ? 1 : -1);
+            emit(e, "s%u = s%u;", writes(e, pushPosition(e)), slot);
+            break;
+        }
+        case OP_JUMP:
+        case OP_LOOP:
+            emitGoto(e, NULL, jumpTarget(e->chunk, offset));
+            return false;
+        case OP_JUMP_IF_FALSE:
+            snprintf(condition, sizeof(condition), "s%u.type != VAL_BOOL",
+                     reads(e, topPosition(e)));
+            emitFail(e, condition, "Condition must be a boolean.");
+            snprintf(condition, sizeof(condition), "!s%u.as.boolean",
+                     reads(e, topPosition(e)));
+            emitGoto(e, condition, jumpTarget(e->chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_LESS:
+            emitCompareJump(e, "numberLess", false,
+                            jumpTarget(e->chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_GREATER:
+            emitCompareJump(e, "numberGreater", false,
+                            jumpTarget(e->chunk, offset));
+            break;
+        case OP_JUMP_IF_LESS:
+            emitCompareJump(e, "numberLess", true,
+                            jumpTarget(e->chunk, offset));
+            break;
+        case OP_JUMP_IF_GREATER:
+            emitCompareJump(e, "numberGreater", true,
+                            jumpTarget(e->chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL: {
+            u32 b = popPosition(e);
+            u32 a = popPosition(e);
+            snprintf(condition, sizeof(condition), "%svaluesEqual(s%u, s%u)",
+                     instruction == OP_JUMP_IF_NOT_EQUAL ? "!" : "",
+                     reads(e, a), reads(e, b));
+            emitGoto(e, condition, jumpTarget(e->chunk, offset));
+            break;
+        }
+        case OP_EQUAL:
+        case OP_EQUAL_NUM: {
+            u32 b = popPosition(e);
+            u32 a = topPosition(e);
+            emit(e, "s%u = BOOL_VAL(valuesEqual(s%u, s%u));", writes(e, a),
+                 reads(e, a), reads(e, b));
+            break;
+        }
+        case OP_LESS:
+        case OP_LESS_NUM:    emitComparison(e, "numberLess"); break;
+        case OP_GREATER:
+        case OP_GREATER_NUM: emitComparison(e, "numberGreater"); break;
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_STR: {
+            u32 b = popPosition(e);
+            u32 a = topPosition(e);
+            emit(e, "if (AOT_NUMBERS(s%u, s%u)) s%u = numberAdd(s%u, s%u);",
+                 reads(e, a), reads(e, b), writes(e, a), a, b);
+            snprintf(condition, sizeof(condition),
+                     "!AOT_NUMBERS(s%u, s%u) && !aotAdd(vm, s%u, s%u, &s%u)",
+                     a, b, a, b, a);
+            emitFail(e, condition, NULL);
+            break;
+        }
+        case OP_SUBTRACT: emitArithmetic(e, "numberSubtract"); break;
+        case OP_MULTIPLY: emitArithmetic(e, "numberMultiply"); break;
+        case OP_DIVIDE:   emitArithmetic(e, "numberDivide"); break;
+        case OP_NOT:
+            snprintf(condition, sizeof(condition), "s%u.type != VAL_BOOL",
+                     reads(e, topPosition(e)));
+            emitFail(e, condition, "operand must be a boolean.");
+            emit(e, "s%u.as.boolean = !s%u.as.boolean;",
+                 writes(e, topPosition(e)), topPosition(e));
+            break;
+        case OP_NEGATE:
+            snprintf(condition, sizeof(condition), "!isNumber(s%u)",
+                     reads(e, topPosition(e)));
+            emitFail(e, condition, "operand must be a number.");
+            emit(e, "s%u = numberNegate(s%u);", writes(e, topPosition(e)),
+                 topPosition(e));
+            break;
+        case OP_BUILD_LIST: {
+            u8 count = operand(e, offset);
+            u32 base = e->depth - count;
+            if (count == 0) {
+                emit(e, "s%u = aotBuildList(vm, NULL, 0);",
+                     writes(e, pushPosition(e)));
+                break;
+            }
+            fputs("    { Value items[] = {", e->body);
+            for (u32 i = 0; i < count; i++) {
+                fprintf(e->body, "%s s%u", i == 0 ? "" : ",",
+                        reads(e, base + i));
+            }
+            fprintf(e->body, " };\n      s%u = aotBuildList(vm, items, %u);\n",
+                    writes(e, base), count);
+            emit(e, "}");
+            e->depth = base + 1;
+            break;
+        }
+        case OP_GET_INDEX: {
+            u32 index = popPosition(e);
+            snprintf(condition, sizeof(condition),
+                     "!aotGetIndex(vm, s%u, s%u, &s%u)",
+                     reads(e, topPosition(e)), reads(e, index),
+                     writes(e, topPosition(e)));
+            emitFail(e, condition, NULL);
+            break;
+        }
+        case OP_SET_INDEX: {
+            u32 value = popPosition(e);
+            u32 index = popPosition(e);
+            snprintf(condition, sizeof(condition),
+                     "!aotSetIndex(vm, s%u, s%u, s%u)",
+                     reads(e, topPosition(e)), reads(e, index),
+                     reads(e, value));
+            emitFail(e, condition, NULL);
+            emit(e, "s%u = s%u;", writes(e, topPosition(e)), value);
+            break;
+        }
+        case OP_LIST_LENGTH:
+            snprintf(condition, sizeof(condition),
+                     "!aotListLength(vm, s%u, &s%u)", reads(e, topPosition(e)),
+                     writes(e, topPosition(e)));
+            emitFail(e, condition, NULL);
+            break;
+        case OP_LIST_APPEND: {
+            u32 value = popPosition(e);
+            snprintf(condition, sizeof(condition),
+                     "!aotListAppend(vm, s%u, s%u)", reads(e, topPosition(e)),
+                     reads(e, value));
+            emitFail(e, condition, NULL);
+            emit(e, "s%u = NIL_VAL;", writes(e, topPosition(e)));
+            break;
+        }
+        case OP_LIST_KERNEL: {
+            ListKernel kernel = (ListKernel)operand(e, offset);
+            u32 base = e->depth - listKernelArity(kernel) - 1;
+            fputs("    { Value operands[] = {", e->body);
+            for (u32 i = base; i < e->depth; i++) {
+                fprintf(e->body, "%s s%u", i == base ? "" : ",", reads(e, i));
+            }
+            fputs(" };\n  ", e->body);
+            snprintf(condition, sizeof(condition),
+                     "!aotListKernel(vm, (ListKernel)%u, operands, &s%u)",
+                     kernel, writes(e, base));
+            emitFail(e, condition, NULL);
+            emit(e, "}");
+            e->depth = base + 1;
+            break;
+        }
+        case OP_CALL:
+            emitCall(e, operand(e, offset), false);
+            break;
+        case OP_TAIL_CALL:
+            emitCall(e, operand(e, offset), true);
+            break;
+        case OP_RETURN:
+            emit(e, "*result = s%u;", reads(e, popPosition(e)));
+            emit(e, "return AOT_RETURNED;");
+            return false;
+        case OP_PRINT:
+            emit(e, "aotPrint(vm, s%u);", reads(e, popPosition(e)));
+            break;
+        default:
+            fprintf(e->vm->err, "Can't translate opcode %d to C.\n",
+                    instruction);
+            e->failed = true;
+            break;
+    }
+    return true;
+}
+
+static bool fallsThrough(u8 instruction) {
+    return instruction != OP_JUMP && instruction != OP_LOOP &&
+           instruction != OP_RETURN;
+}
+
+// Marks the targets of jumps in reachable code, so dead jumps leave no
+// unused labels behind. A backward jump can bring an earlier label to life
+// (the increment clause of a for loop), so this runs until nothing changes.
+static void markTargets(Emitter* e) {
+    Chunk* chunk = e->chunk;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        bool reachable = true;
+        for (u32 offset = 0; offset < chunk->count;
+             offset += instructionLength(chunk->code[offset])) {
+            if (e->isTarget[offset]) reachable = true;
+            if (!reachable) continue;
+            u8 instruction = chunk->code[offset];
+            if (instructionLength(instruction) == 3 &&
+                !e->isTarget[jumpTarget(chunk, offset)]) {
+                e->isTarget[jumpTarget(chunk, offset)] = true;
+                changed = true;
+            }
+            reachable = fallsThrough(instruction);
+        }
+    }
+}
+
+// Code after a return or an unconditional jump is dead until the next
+// label and is skipped. A label that nothing falls into takes the depth
+// recorded by the jumps to it. The increment clause of a for loop is only
+// reached by a later backward jump, so none is recorded yet. It keeps the
+// depth from before the jump over it, which is the same because the
+// compiler keeps the stack balanced across jumps.
+static void emitBody(Emitter* e) {
+    Chunk* chunk = e->chunk;
+    markTargets(e);
+
+    bool reachable = true;
+    for (u32 offset = 0; offset < chunk->count && !e->failed;
+         offset += instructionLength(chunk->code[offset])) {
+        if (e->isTarget[offset]) {
+            if (!reachable && e->depthAt[offset] >= 0) {
+                e->depth = (u32)e->depthAt[offset];
+            }
+            fprintf(e->body, "L%u:;\n", offset);
+            reachable = true;
+        }
+        if (!reachable) continue;
+        e->line = getLine(&chunk->runTable, offset);
+        reachable = emitInstruction(e, offset);
+    }
+}
+
+static bool emitFunction(VM* vm, FILE* out, const FunctionList* program,
+                         u32 index) {
+    ObjFunction* function = program->functions[index];
+    Chunk* chunk = &function->chunk;
+
+    Emitter e;
+    e.vm = vm;
+    e.body = tmpfile();
+    if (e.body == NULL) {
+        fprintf(vm->err, "Could not create a temporary file.\n");
+        return false;
+    }
+    e.function = function;
+    e.index = index;
+    e.chunk = chunk;
+    e.depth = 0;
+    e.maxDepth = 0;
+    e.line = 0;
+    e.selfTailCall = false;
+    e.failed = false;
+    e.isTarget = ALLOCATE(vm, bool, chunk->count + 1, MEM_CHUNK_CODE);
+    e.depthAt = ALLOCATE(vm, i32, chunk->count + 1, MEM_CHUNK_CODE);
+    for (u32 i = 0; i <= chunk->count; i++) {
+        e.isTarget[i] = false;
+        e.depthAt[i] = -1;
+    }
+    // Each instruction pushes at most one value.
+    u32 positions = function->arity + 1 + chunk->count;
+    e.uses = ALLOCATE(vm, u8, positions, MEM_CHUNK_CODE);
+    for (u32 i = 0; i < positions; i++) e.uses[i] = 0;
+
+    // Slot 0 holds the callee, then come the parameters.
+    for (u32 slot = 0; slot <= function->arity; slot++) pushPosition(&e);
+    emitBody(&e);
+
+    if (!e.failed) {
+        fputs("\nstatic AotStatus ", out);
+        printEntryName(out, program, index);
+        fputs("(VM* vm, u32 depth, Value* args, Value* result) {\n", out);
+        for (u32 position = 0; position < e.maxDepth; position++) {
+            u8 uses = e.uses[position];
+            if (uses == 0) continue;
+            if (position <= function->arity) {
+                fprintf(out, "    Value s%u = args[%u];\n", position,
+                        position);
+            } else {
+                fprintf(out, "    Value s%u;\n", position);
+            }
+            if (!(uses & POSITION_READ)) {
+                fprintf(out, "    (void)s%u;\n", position);
+            }
+        }
+        // Short functions need not touch every parameter.
+        fputs("    (void)vm;\n    (void)depth;\n    (void)args;\n", out);
+        if (e.selfTailCall) fputs("start:;\n", out);
+        rewind(e.body);
+        char buffer[4096];
+        usize read;
+        while ((read = fread(buffer, 1, sizeof(buffer), e.body)) > 0) {
+            fwrite(buffer, 1, read, out);
+        }
+        fputs("}\n", out);
+    }
+
+    fclose(e.body);
+    FREE_ARRAY(vm, bool, e.isTarget, chunk->count + 1, MEM_CHUNK_CODE);
+    FREE_ARRAY(vm, i32, e.depthAt, chunk->count + 1, MEM_CHUNK_CODE);
+    FREE_ARRAY(vm, u8, e.uses, positions, MEM_CHUNK_CODE);
+    return !e.failed;
+}
+
+static void emitConstants(FILE* out, const FunctionList* program, u32 index) {
+    ValueArray* constants = &program->functions[index]->chunk.constants;
+    for (u32 i = 0; i < constants->count; i++) {
+        Value constant = constants->values[i];
+        fprintf(out, "    k%u[%u] = ", index, i);
+        if (constant.type == VAL_INT) {
+            fprintf(out, "INT_VAL(INT64_C(%" I64_FMT "));\n",
+                    constant.as.integer);
+        } else if (constant.type == VAL_NUMBER) {
+            fprintf(out, "NUMBER_VAL(%a);", constant.as.number);
+            fprintf(out, "  // %.17g\n", constant.as.number);
+        } else if (isObjType(constant, OBJ_STRING)) {
+            ObjString* string = stringFrom(constant);
+            fputs("aotString(vm, ", out);
+            printCString(out, string->chars, string->length);
+            fprintf(out, ", %u);\n", string->length);
+        } else if (isObjType(constant, OBJ_FUNCTION)) {
+            fprintf(out, "OBJ_VAL(functions[%u]);\n",
+                    functionIndex(program, functionFrom(constant)));
+        } else {
+            fputs("NIL_VAL;\n", out);
+        }
+    }
+}
+
+bool emitC(VM* vm, ObjFunction* script, const char* sourcePath, FILE* out) {
+    FunctionList program = { .functions = NULL, .count = 0, .capacity = 0 };
+    appendFunction(vm, &program, script);
+
+    fprintf(out, "// Generated by clox --emit-c from %s.\n", sourcePath);
+    fputs("#include <stdio.h>\n\n#include \"aot.h\"\n\n", out);
+
+    // functions[0] stays NULL: the script is never called as a value.
+    fprintf(out, "static ObjFunction* functions[%u];\n", program.count);
+    for (u32 i = 0; i < program.count; i++) {
+        u32 count = program.functions[i]->chunk.constants.count;
+        if (count > 0) fprintf(out, "static Value k%u[%u];\n", i, count);
+    }
+    fputc('\n', out);
+    for (u32 i = 0; i < program.count; i++) {
+        fputs("static AotStatus ", out);
+        printEntryName(out, &program, i);
+        fputs("(VM* vm, u32 depth, Value* args, Value* result);\n", out);
+    }
+    fprintf(out, "\nstatic const AotEntry entries[%u] = {\n", program.count);
+    for (u32 i = 0; i < program.count; i++) {
+        fputs("    ", out);
+        printEntryName(out, &program, i);
+        fputs(",\n", out);
+    }
+    fprintf(out, "};\nstatic const AotProgram program = "
+                 "{ functions, entries, %u };\n", program.count);
+
+    bool ok = true;
+    for (u32 i = 0; i < program.count && ok; i++) {
+        ok = emitFunction(vm, out, &program, i);
+    }
+
+    if (ok) {
+        fputs("\nint main(void) {\n    VM* vm = newVM();\n", out);
+        for (u32 i = 1; i < program.count; i++) {
+            ObjFunction* function = program.functions[i];
+            fprintf(out, "    functions[%u] = aotNewFunction(vm, \"%s\", "
+                         "%u);\n", i, function->name->chars, function->arity);
+        }
+        for (u32 i = 0; i < program.count; i++) {
+            emitConstants(out, &program, i);
+        }
+        fputs("\n    int status = aotRunScript(vm, &program);\n"
+              "    freeVM(vm);\n"
+              "    return status;\n"
+              "}\n", out);
+    }
+
+    FREE_ARRAY(vm, ObjFunction*, program.functions, program.capacity,
+               MEM_FUNCTION_OBJ);
+    return ok;
+}
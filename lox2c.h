@@ -0,0 +1,18 @@
+#ifndef clox_lox2c_h
+#define clox_lox2c_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+// Writes a compiled script out as a standalone C translation unit (--emit-c).
+// The output includes aot.h and links against libclox.a:
+//
+//     cc -O2 -I<clox> script.c <clox>/libclox.a -lm -pthread
+//
+// Returns false, after reporting why on vm->err, for bytecode it cannot
+// translate.
+bool emitC(VM* vm, ObjFunction* script, const char* sourcePath, FILE* out);
+
+#endif
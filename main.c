@@ -2,12 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "batch.h"
 #include "common.h"
 #include "chunk.h"
+#include "compiler.h"
 #include "debug.h"
+#include "file.h"
+#include "jit.h"
+#include "lox2c.h"
+#include "memory.h"
+#include "perf_stats.h"
+#include "profiler.h"
+#include "sampler.h"
 #include "vm.h"
 
-static void repl() {
+static void repl(VM* vm) {
     char line[1024];
     for ever {
         printf("> ");
@@ -17,67 +26,158 @@ static void repl() {
             break;
         }
 
-        interpret(line);
+        vmInterpret(vm, line);
     }
 }
 
-static char* readFile(const char* path) {
-    FILE* file = fopen(path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open file \"%s\".\n", path);
-        exit(74);
-    }
+static int runFile(VM* vm, const char* path) {
+    char* source = readFile(path, stderr);
+    if (source == NULL) return 74;
 
-    fseek(file, 0L, SEEK_END);
-    usize fileSize = ftell(file);
-    rewind(file);
+    InterpretResult result = vmInterpret(vm, source);
 
-    char* buffer = (char*)malloc(fileSize + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-        exit(74);
-    }
+    free(source);
 
-    usize bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    if (bytesRead < fileSize) {
-        fprintf(stderr, "Could not read file \"%s\".\n", path);
-        exit(74);
+    switch(result) {
+        case INTERPRET_OK: return OK;
+        case INTERPRET_COMPILE_ERROR: return 65;
+        case INTERPRET_RUNTIME_ERROR: return 70;
     }
-    buffer[bytesRead] = '\0';
-
-    fclose(file);
-    return buffer;
+    return OK;
 }
 
-static void runFile(const char* path) {
-    char* source = readFile(path);
-    InterpretResult result = interpret(source);
+// Compiles the script and writes it out as C instead of running it.
+static int emitFile(VM* vm, const char* path, const char* outPath) {
+    char* source = readFile(path, stderr);
+    if (source == NULL) return 74;
 
-cleanup:
+    ObjFunction* script = compile(vm, source);
     free(source);
+    if (script == NULL) return 65;
 
-    switch(result) {
-        case INTERPRET_OK: break; // do nothing
-        case INTERPRET_COMPILE_ERROR: exit(65);
-        case INTERPRET_RUNTIME_ERROR: exit(70);
+    FILE* out = fopen(outPath, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", outPath);
+        return 74;
+    }
+    bool ok = emitC(vm, script, path, out);
+    fclose(out);
+    if (!ok) {
+        remove(outPath);
+        return 65;
     }
+    return OK;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: clox [--profile] [--sample[=out.folded]] "
+                    "[--mem-stats] [--perf-stats] [--registers | --jit] "
+                    "[path]\n"
+                    "       clox --emit-c out.c path\n"
+                    "       clox [--jobs N] [--manifest file] "
+                    "[--shared-strings] path...\n");
+    exit(64);
 }
 
 int main(int argc, const char* argv[]) {
-    initVM();
+    ScriptList scripts;
+    initScriptList(&scripts);
+    u32 workerCount = 0;
+    bool batchMode = false;
+    bool profile = false;
+    const char* samplePath = NULL;
+    bool memStats = false;
+    bool perfStats = false;
+    bool sharedStrings = false;
+    bool registers = false;
+    bool jit = false;
+    const char* emitPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--sample") == 0) {
+            samplePath = "clox.folded";
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            samplePath = argv[i] + 9;
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            memStats = true;
+        } else if (strcmp(argv[i], "--perf-stats") == 0) {
+            perfStats = true;
+        } else if (strcmp(argv[i], "--registers") == 0) {
+            registers = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            jit = true;
+        } else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc) {
+            emitPath = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            workerCount = (u32)atoi(argv[++i]);
+            if (workerCount == 0) usage();
+            batchMode = true;
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            if (!appendManifest(&scripts, argv[++i])) exit(74);
+            batchMode = true;
+        } else if (strcmp(argv[i], "--shared-strings") == 0) {
+            sharedStrings = true;
+        } else if (argv[i][0] != '-') {
+            appendScript(&scripts, argv[i], strlen(argv[i]));
+        } else {
+            usage();
+        }
+    }
+    if (scripts.count > 1) batchMode = true;
+
+    if (emitPath != NULL && (batchMode || scripts.count == 0)) usage();
+
+    if (batchMode) {
+        // The profilers and counters are process-wide; they only make
+        // sense for a single interpreter.
+        if (profile || samplePath != NULL || memStats || perfStats ||
+            registers || jit) {
+            fprintf(stderr, "--profile, --sample, --mem-stats, --perf-stats, "
+                            "--registers and --jit take a single script.\n");
+            exit(64);
+        }
 
-    if (argc == 1) {
-        repl();
-    } else if (argc == 2) {
-        runFile(argv[1]);
-    } else {
-        fprintf(stderr, "Usage: clox [path]\n");
+        if (workerCount == 0) workerCount = defaultWorkerCount();
+        int status = runBatch(&scripts, workerCount, sharedStrings);
+        freeScriptList(&scripts);
+        return status;
+    }
+
+    if (profile) {
+#ifdef PROFILE_OPCODES
+        enableProfiler();
+#else
+        fprintf(stderr, "clox was built without PROFILE_OPCODES.\n");
         exit(64);
+#endif
+    }
+    if (registers && jit) usage();
+    if (jit && !jitAvailable()) {
+        fprintf(stderr, "--jit is only supported on x86-64 Linux.\n");
+        exit(64);
+    }
+    if (samplePath != NULL) enableSampler(samplePath);
+    if (perfStats) enablePerfStats();
+
+    VM* vm = newVM();
+    vm->registerBackend = registers;
+    vm->jitEnabled = jit;
+
+    int status = OK;
+    if (emitPath != NULL) {
+        status = emitFile(vm, scripts.paths[0], emitPath);
+    } else if (scripts.count == 0) {
+        repl(vm);
+    } else {
+        status = runFile(vm, scripts.paths[0]);
     }
 
-cleanup:
-    freeVM();
-    return OK;
+    if (memStats) printMemStats(vm, stderr);
+    freeVM(vm);
+    freeScriptList(&scripts);
+    return status;
 }
 
 // Chunk chunk;
@@ -1,35 +1,197 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
+#include "chunk.h"
+#include "jit.h"
 #include "memory.h"
+#include "register_code.h"
+#include "slab.h"
 #include "vm.h"
 
-void* reallocate(void* pointer, usize oldSize, usize newSize) {
+static void countResize(MemCounters* counters, usize oldSize, usize newSize) {
+    if (oldSize == 0 && newSize != 0) {
+        counters->allocations++;
+    } else if (oldSize != 0 && newSize == 0) {
+        counters->frees++;
+    } else if (oldSize != newSize) {
+        counters->reallocations++;
+    }
+
+    counters->liveBytes += newSize;
+    counters->liveBytes -= oldSize;
+    if (counters->liveBytes > counters->peakBytes) {
+        counters->peakBytes = counters->liveBytes;
+    }
+}
+
+static void* systemReallocate(void* context, void* pointer, usize oldSize,
+                              usize newSize) {
+    (void)context;
+    (void)oldSize;  // realloc() tracks block sizes itself
     if (newSize == 0) {
         free(pointer);
         return NULL;
     }
+    return realloc(pointer, newSize);
+}
+
+const Allocator systemAllocator = {
+    .reallocate = systemReallocate,
+    .context = NULL,
+};
+
+static bool inArena(MemTag tag) {
+    return tag == MEM_CHUNK_CODE || tag == MEM_RUN_TABLE ||
+           tag == MEM_CONSTANTS;
+}
+
+static bool inSlabs(MemTag tag) {
+    return tag == MEM_FUNCTION_OBJ || tag == MEM_LIST_OBJ ||
+           tag == MEM_NATIVE_OBJ || tag == MEM_STRING_OBJ ||
+           tag == MEM_STRING_CHARS;
+}
 
-    void* result = realloc(pointer, newSize);
+static void* allocateSized(VM* vm, usize size) {
+    if (size <= SLAB_MAX_SIZE) {
+        return slabAllocate(&vm->slabs, &vm->allocator, size);
+    }
+    void* result = vm->allocator.reallocate(vm->allocator.context, NULL, 0,
+                                            size);
     if (result == NULL) exit(SYSERR);
     return result;
 }
 
-static void freeObject(Obj* object) {
+static void freeSized(VM* vm, void* pointer, usize size) {
+    if (size <= SLAB_MAX_SIZE) {
+        slabFree(&vm->slabs, pointer, size);
+    } else {
+        vm->allocator.reallocate(vm->allocator.context, pointer, size, 0);
+    }
+}
+
+// Small sizes live in the slabs, bigger ones come from the allocator, and
+// a resize that crosses between the two moves the bytes.
+static void* resizeSlabbed(VM* vm, void* pointer, usize oldSize,
+                           usize newSize) {
+    if (oldSize != 0 && newSize != 0 && oldSize <= SLAB_MAX_SIZE &&
+        newSize <= SLAB_MAX_SIZE &&
+        slabClassOf(oldSize) == slabClassOf(newSize)) {
+        return pointer;
+    }
+    void* result = newSize == 0 ? NULL : allocateSized(vm, newSize);
+    if (oldSize != 0) {
+        if (result != NULL) {
+            memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        }
+        freeSized(vm, pointer, oldSize);
+    }
+    return result;
+}
+
+void* reallocate(VM* vm, void* pointer, usize oldSize, usize newSize,
+                 MemTag tag) {
+    countResize(&vm->memStats.total, oldSize, newSize);
+    countResize(&vm->memStats.byTag[tag], oldSize, newSize);
+
+    if (inArena(tag)) {
+        return arenaResize(&vm->arena, &vm->allocator, pointer, oldSize,
+                           newSize);
+    }
+    if (inSlabs(tag) &&
+        (oldSize <= SLAB_MAX_SIZE || newSize <= SLAB_MAX_SIZE)) {
+        return resizeSlabbed(vm, pointer, oldSize, newSize);
+    }
+
+    void* result = vm->allocator.reallocate(vm->allocator.context, pointer,
+                                            oldSize, newSize);
+    if (result == NULL && newSize != 0) exit(SYSERR);
+    return result;
+}
+
+static void freeObject(VM* vm, Obj* object) {
     switch (object->type) {
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            freeChunk(vm, &function->chunk);
+            if (function->registers != NULL) {
+                freeRegisterCode(vm, function->registers);
+            }
+            if (function->jit != NULL) freeJitCode(vm, function->jit);
+            FREE(vm, ObjFunction, object, MEM_FUNCTION_OBJ);
+            break;
+        }
+        case OBJ_LIST: {
+            ObjList* list = (ObjList*)object;
+            FREE_ARRAY(vm, Value, list->items.values, list->items.capacity,
+                       MEM_LIST_ITEMS);
+            FREE(vm, ObjList, object, MEM_LIST_OBJ);
+            break;
+        }
+        case OBJ_NATIVE:
+            FREE(vm, ObjNative, object, MEM_NATIVE_OBJ);
+            break;
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
-            FREE_ARRAY(char, string->chars, string->length + 1);
-            FREE(ObjString, object);
+            FREE_ARRAY(vm, char, string->chars, string->length + 1,
+                       MEM_STRING_CHARS);
+            FREE(vm, ObjString, object, MEM_STRING_OBJ);
             break;
         }
     }
 }
 
-void freeObjects() {
-    Obj* object = vm.objects;
+void freeObjects(VM* vm) {
+    Obj* object = vm->objects;
     while (object != NULL) {
         Obj* next = object->next;
-        freeObject(object);
+        freeObject(vm, object);
         object = next;
     }
 }
+
+const MemStats* getMemStats(VM* vm) {
+    return &vm->memStats;
+}
+
+const char* memTagName(MemTag tag) {
+    switch (tag) {
+        case MEM_CHUNK_CODE:    return "chunk code";
+        case MEM_RUN_TABLE:     return "run table";
+        case MEM_CONSTANTS:     return "constants";
+        case MEM_HASH_TABLE:    return "hash tables";
+        case MEM_FUNCTION_OBJ:  return "functions";
+        case MEM_LIST_OBJ:      return "list objects";
+        case MEM_LIST_ITEMS:    return "list items";
+        case MEM_NATIVE_OBJ:    return "natives";
+        case MEM_REGISTER_CODE: return "register code";
+        case MEM_JIT_CODE:      return "jit code";
+        case MEM_STRING_OBJ:    return "string objects";
+        case MEM_STRING_CHARS:  return "string chars";
+        default:                return "unknown";
+    }
+}
+
+static void printCounters(FILE* out, const char* name,
+                          const MemCounters* counters) {
+    fprintf(out, "%-16s %12" USIZE_FMT " %12" USIZE_FMT " %10" U64_FMT
+            " %10" U64_FMT " %10" U64_FMT "\n",
+            name, counters->liveBytes, counters->peakBytes,
+            counters->allocations, counters->reallocations, counters->frees);
+}
+
+void printMemStats(VM* vm, FILE* out) {
+    const MemStats* stats = &vm->memStats;
+    fprintf(out, "== memory ==\n");
+    fprintf(out, "%-16s %12s %12s %10s %10s %10s\n",
+            "category", "live", "peak", "allocs", "reallocs", "frees");
+    for (u32 tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        printCounters(out, memTagName((MemTag)tag), &stats->byTag[tag]);
+    }
+    printCounters(out, "total", &stats->total);
+    fprintf(out, "%-16s %12" USIZE_FMT "\n", "arena reserved",
+            vm->arena.reserved);
+    fprintf(out, "%-16s %12" USIZE_FMT "\n", "slabs reserved",
+            vm->slabs.reserved);
+}
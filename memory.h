@@ -1,26 +1,81 @@
 #ifndef clox_memory_h
 #define clox_memory_h
 
+#include <stdio.h>
+
 #include "common.h"
 #include "object.h"
 
-#define ALLOCATE(type, count) \
-    (type*)reallocate(NULL, 0, sizeof(type) * (count))
+// Every allocation is tagged with what it is for, so --mem-stats can break
+// the heap down by container.
+typedef enum {
+    MEM_CHUNK_CODE,
+    MEM_RUN_TABLE,
+    MEM_CONSTANTS,
+    MEM_HASH_TABLE,
+    MEM_FUNCTION_OBJ,
+    MEM_LIST_OBJ,
+    MEM_LIST_ITEMS,
+    MEM_NATIVE_OBJ,
+    MEM_REGISTER_CODE,
+    MEM_JIT_CODE,
+    MEM_STRING_OBJ,
+    MEM_STRING_CHARS,
+    MEM_TAG_COUNT,
+} MemTag;
+
+typedef struct {
+    usize liveBytes;
+    usize peakBytes;
+    u64 allocations;
+    u64 reallocations;
+    u64 frees;
+} MemCounters;
+
+typedef struct {
+    MemCounters total;
+    MemCounters byTag[MEM_TAG_COUNT];
+} MemStats;
+
+// Where a VM gets its memory, chosen when the VM is created. `reallocate`
+// has realloc() semantics, with a NULL pointer to allocate and a zero
+// newSize to free; it also gets the old size, for sized deallocation. It
+// may return NULL only when out of memory.
+typedef struct {
+    void* (*reallocate)(void* context, void* pointer, usize oldSize,
+                        usize newSize);
+    void* context;
+} Allocator;
 
-#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
+// realloc() and free().
+extern const Allocator systemAllocator;
+
+#define ALLOCATE(vm, type, count, tag) \
+    (type*)reallocate(vm, NULL, 0, sizeof(type) * (count), tag)
+
+#define FREE(vm, type, pointer, tag) \
+    reallocate(vm, pointer, sizeof(type), 0, tag)
 
 #define GROW_CAPACITY(capacity) \
     ((capacity) < 8 ? 8 : (capacity) * 2)
 
-#define GROW_ARRAY(type, pointer, oldCount, newCount) \
-    (type*)reallocate(pointer, sizeof(type) * (oldCount), \
-        sizeof(type) * (newCount))
+#define GROW_ARRAY(vm, type, pointer, oldCount, newCount, tag) \
+    (type*)reallocate(vm, pointer, sizeof(type) * (oldCount), \
+        sizeof(type) * (newCount), tag)
+
+#define FREE_ARRAY(vm, type, pointer, oldCount, tag) \
+    reallocate(vm, pointer, sizeof(type) * (oldCount), 0, tag)
 
-#define FREE_ARRAY(type, pointer, oldCount) \
-    reallocate(pointer, sizeof(type) * (oldCount), 0)
+// Chunk code, line runs and constants come out of the VM's arena. Objects
+// and short string payloads come out of its slabs. Everything else goes
+// straight to its allocator.
+void* reallocate(VM* vm, void* pointer, size_t oldSize, size_t newSize,
+                 MemTag tag);
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+void freeObjects(VM* vm);
 
-void freeObjects();
+const MemStats* getMemStats(VM* vm);
+const char* memTagName(MemTag tag);
+void printMemStats(VM* vm, FILE* out);
 
 #endif
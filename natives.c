@@ -0,0 +1,130 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory.h"
+#include "natives.h"
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+static bool expectNumber(VM* vm, const char* native, Value value) {
+    if (isNumber(value)) return true;
+    runtimeError(vm, "%s() takes a number.", native);
+    return false;
+}
+
+// A runtime string, left uninterned like any other.
+static Value stringValue(VM* vm, const char* chars, int length) {
+    char* heapChars = ALLOCATE(vm, char, length + 1, MEM_STRING_CHARS);
+    memcpy(heapChars, chars, (usize)length);
+    heapChars[length] = '\0';
+    return OBJ_VAL(takeString(vm, heapChars, (u32)length));
+}
+
+// Seconds of processor time, for timing benchmarks from inside a script.
+static bool clockNative(VM* vm, u32 argCount, Value* args, Value* result) {
+    (void)vm;
+    (void)argCount;  // every native's arity is checked before the call
+    (void)args;
+    *result = NUMBER_VAL((f64)clock() / CLOCKS_PER_SEC);
+    return true;
+}
+
+static bool lenNative(VM* vm, u32 argCount, Value* args, Value* result) {
+    (void)argCount;
+
+    if (isObjType(args[0], OBJ_STRING)) {
+        *result = INT_VAL(stringFrom(args[0])->length);
+    } else if (isObjType(args[0], OBJ_LIST)) {
+        *result = INT_VAL(listFrom(args[0])->items.count);
+    } else {
+        runtimeError(vm, "len() takes a string or a list.");
+        return false;
+    }
+    return true;
+}
+
+// Formats a value the way print would show it.
+static bool strNative(VM* vm, u32 argCount, Value* args, Value* result) {
+    (void)argCount;
+
+    char buffer[NUMBER_BUFFER_SIZE];
+    int length;
+    switch (args[0].type) {
+        case VAL_NUMBER:
+            length = (int)formatNumber(args[0].as.number, buffer);
+            break;
+        case VAL_INT:
+            length = (int)formatInteger(args[0].as.integer, buffer);
+            break;
+        case VAL_BOOL:
+            length = snprintf(buffer, sizeof(buffer), "%s",
+                              args[0].as.boolean ? "true" : "false");
+            break;
+        case VAL_NIL:
+            length = snprintf(buffer, sizeof(buffer), "nil");
+            break;
+        default:
+            if (isObjType(args[0], OBJ_STRING)) {
+                *result = args[0];
+                return true;
+            }
+            runtimeError(vm, "str() takes a number, bool, nil or string.");
+            return false;
+    }
+
+    *result = stringValue(vm, buffer, length);
+    return true;
+}
+
+// format(number, digits): fixed-point with that many digits after the point.
+static bool formatNative(VM* vm, u32 argCount, Value* args, Value* result) {
+    (void)argCount;
+
+    if (!expectNumber(vm, "format", args[0])) return false;
+    f64 digits = isNumber(args[1]) ? asNumber(args[1]) : -1;
+    if (digits < 0 || digits > 20 || digits != floor(digits)) {
+        runtimeError(vm, "format() digits must be an integer from 0 to 20.");
+        return false;
+    }
+
+    char buffer[512];
+    int length = snprintf(buffer, sizeof(buffer), "%.*f", (int)digits,
+                          asNumber(args[0]));
+    if (length < 0 || (usize)length >= sizeof(buffer)) {
+        runtimeError(vm, "format() result is too long.");
+        return false;
+    }
+
+    *result = stringValue(vm, buffer, length);
+    return true;
+}
+
+static bool sqrtNative(VM* vm, u32 argCount, Value* args, Value* result) {
+    (void)argCount;
+
+    if (!expectNumber(vm, "sqrt", args[0])) return false;
+    *result = NUMBER_VAL(sqrt(asNumber(args[0])));
+    return true;
+}
+
+static bool floorNative(VM* vm, u32 argCount, Value* args, Value* result) {
+    (void)argCount;
+
+    if (!expectNumber(vm, "floor", args[0])) return false;
+    // Integers are already whole.
+    *result = args[0].type == VAL_INT ? args[0]
+                                      : NUMBER_VAL(floor(args[0].as.number));
+    return true;
+}
+
+void defineStandardNatives(VM* vm) {
+    defineNative(vm, "clock", clockNative, 0);
+    defineNative(vm, "len", lenNative, 1);
+    defineNative(vm, "str", strNative, 1);
+    defineNative(vm, "format", formatNative, 2);
+    defineNative(vm, "sqrt", sqrtNative, 1);
+    defineNative(vm, "floor", floorNative, 1);
+}
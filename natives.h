@@ -0,0 +1,10 @@
+#ifndef clox_natives_h
+#define clox_natives_h
+
+#include "common.h"
+
+// The built-in natives every VM starts with: clock, len, str, format, sqrt
+// and floor.
+void defineStandardNatives(VM* vm);
+
+#endif
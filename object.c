@@ -4,33 +4,82 @@
 #include "memory.h"
 #include "object.h"
 #include "hash_table.h"
+#include "shared_strings.h"
 #include "value.h"
 #include "vm.h"
 
-extern VM vm;
+#define ALLOCATE_OBJ(vm, type, objectType, tag) \
+    (type*)allocateObject(vm, sizeof(type), objectType, tag)
 
-#define ALLOCATE_OBJ(type, objectType) \
-    (type*)allocateObject(sizeof(type), objectType)
-
-static Obj* allocateObject(usize size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size);
+static Obj* allocateObject(VM* vm, usize size, ObjType type, MemTag tag) {
+    Obj* object = (Obj*)reallocate(vm, NULL, 0, size, tag);
     object->type = type;
 
-    object->next = vm.objects;
-    vm.objects = object;
+    object->next = vm->objects;
+    vm->objects = object;
 
     return object;
 }
 
-static ObjString* allocateString(char* chars, u32 length, u32 hash) {
-    ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+ObjFunction* newFunction(VM* vm) {
+    ObjFunction* function = ALLOCATE_OBJ(vm, ObjFunction, OBJ_FUNCTION,
+                                         MEM_FUNCTION_OBJ);
+    function->arity = 0;
+    function->name = NULL;
+    function->registers = NULL;
+    function->jit = NULL;
+    initChunk(&function->chunk);
+    return function;
+}
+
+ObjNative* newNative(VM* vm, NativeFn function, i32 arity, ObjString* name) {
+    ObjNative* native = ALLOCATE_OBJ(vm, ObjNative, OBJ_NATIVE,
+                                     MEM_NATIVE_OBJ);
+    native->function = function;
+    native->arity = arity;
+    native->name = name;
+    return native;
+}
+
+// Allocates room for exactly `capacity` items up front, so a list built
+// from a literal of known size never regrows.
+ObjList* newList(VM* vm, u32 capacity) {
+    ObjList* list = ALLOCATE_OBJ(vm, ObjList, OBJ_LIST, MEM_LIST_OBJ);
+    initValueArray(&list->items);
+    if (capacity > 0) {
+        list->items.values = ALLOCATE(vm, Value, capacity, MEM_LIST_ITEMS);
+        list->items.capacity = capacity;
+    }
+    return list;
+}
+
+void appendList(VM* vm, ObjList* list, Value value) {
+    ValueArray* items = &list->items;
+    if (items->capacity <= items->count) {
+        u32 oldCapacity = items->capacity;
+        items->capacity = GROW_CAPACITY(oldCapacity);
+        items->values = GROW_ARRAY(vm, Value, items->values, oldCapacity,
+                                   items->capacity, MEM_LIST_ITEMS);
+    }
+    items->values[items->count++] = value;
+}
+
+static ObjString* allocateString(VM* vm, char* chars, u32 length) {
+    ObjString* string = ALLOCATE_OBJ(vm, ObjString, OBJ_STRING,
+                                     MEM_STRING_OBJ);
     string->length = length;
     string->chars = chars;
-    string->hash = hash;
-    hashTableSet(&vm.strings, string, NIL_VAL);
+    string->hash = 0;
+    string->state = STRING_UNHASHED;
     return string;
 }
 
+static void intern(VM* vm, ObjString* string, u32 hash) {
+    string->hash = hash;
+    string->state = STRING_INTERNED;
+    hashTableSet(vm, &vm->strings, string, NIL_VAL);
+}
+
 static u32 hashString(const char* key, u32 length) {
     u32 hash = 2166136261u;
     for (u32 i = 0; i < length; i++) {
@@ -40,32 +89,103 @@ static u32 hashString(const char* key, u32 length) {
     return hash;
 }
 
-ObjString* takeString(char* chars, u32 length) {
-    u32 hash = hashString(chars, length);
-    ObjString* interned = hashTableFindString(&vm.strings, chars, length, hash);
-    if (interned != NULL) {
-        FREE_ARRAY(char, chars, length + 1);
-        return interned;
+// With shared strings, a VM's own table is always consulted first: once a
+// string exists locally it must keep winning, or the VM could end up with
+// two distinct objects for the same characters.
+static ObjString* findInterned(VM* vm, const char* chars, u32 length,
+                               u32 hash) {
+    ObjString* interned = hashTableFindString(&vm->strings, chars, length,
+                                              hash);
+    if (interned == NULL && vm->sharedStrings) {
+        interned = findSharedString(chars, length, hash);
     }
+    return interned;
+}
 
-    return allocateString(chars, length, hash);
+ObjString* takeString(VM* vm, char* chars, u32 length) {
+    return allocateString(vm, chars, length);
 }
 
-ObjString* copyString(const char* chars, u32 length) {
+// Strings copied out of source code (identifiers and literals) go to the
+// shared table when enabled. Strings built at runtime stay VM-local.
+ObjString* copyString(VM* vm, const char* chars, u32 length) {
     u32 hash = hashString(chars, length);
-    ObjString* interned = hashTableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = findInterned(vm, chars, length, hash);
     if (interned != NULL) return interned;
+    if (vm->sharedStrings) return internSharedString(chars, length, hash);
 
-    char* heapChars = ALLOCATE(char, length + 1);
+    char* heapChars = ALLOCATE(vm, char, length + 1, MEM_STRING_CHARS);
     memcpy(heapChars, chars, length);
     heapChars[length] = '\0';
-    return allocateString(heapChars, length, hash);
+    ObjString* string = allocateString(vm, heapChars, length);
+    intern(vm, string, hash);
+    return string;
 }
 
-void printObject(Value value) {
+ObjString* concatStrings(VM* vm, ObjString* a, ObjString* b) {
+    u32 length = a->length + b->length;
+    char* chars = ALLOCATE(vm, char, length + 1, MEM_STRING_CHARS);
+    memcpy(chars, a->chars, a->length);
+    memcpy(chars + a->length, b->chars, b->length);
+    chars[length] = '\0';
+
+    return takeString(vm, chars, length);
+}
+
+u32 stringHash(ObjString* string) {
+    if (string->state == STRING_UNHASHED) {
+        string->hash = hashString(string->chars, string->length);
+        string->state = STRING_HASHED;
+    }
+    return string->hash;
+}
+
+// Two interned strings are equal only if they are the same object.
+bool stringsEqual(ObjString* a, ObjString* b) {
+    if (a == b) return true;
+    if (a->state == STRING_INTERNED && b->state == STRING_INTERNED) {
+        return false;
+    }
+    return a->length == b->length && stringHash(a) == stringHash(b) &&
+           memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+static void writeFunction(OutputBuffer* output, ObjFunction* function) {
+    if (function->name == NULL) {
+        writeBytes(output, "<script>", 8);
+        return;
+    }
+    writeBytes(output, "<fn ", 4);
+    writeBytes(output, function->name->chars, function->name->length);
+    writeChar(output, '>');
+}
+
+static void writeList(OutputBuffer* output, ObjList* list) {
+    writeChar(output, '[');
+    for (u32 i = 0; i < list->items.count; i++) {
+        if (i > 0) writeBytes(output, ", ", 2);
+        writeValue(output, list->items.values[i]);
+    }
+    writeChar(output, ']');
+}
+
+void writeObject(OutputBuffer* output, Value value) {
     switch (value.as.obj->type) {
+        case OBJ_FUNCTION:
+            writeFunction(output, functionFrom(value));
+            break;
+        case OBJ_LIST:
+            writeList(output, listFrom(value));
+            break;
+        case OBJ_NATIVE: {
+            ObjString* name = nativeFrom(value)->name;
+            writeBytes(output, "<native fn ", 11);
+            writeBytes(output, name->chars, name->length);
+            writeChar(output, '>');
+            break;
+        }
         case OBJ_STRING:
-            printf("%s", cstringFrom(value));
+            writeBytes(output, cstringFrom(value), stringFrom(value)->length);
             break;
     }
 }
@@ -1,10 +1,14 @@
 #ifndef clox_object_h
 #define clox_object_h
 
+#include "chunk.h"
 #include "common.h"
 #include "value.h"
 
 typedef enum {
+    OBJ_FUNCTION,
+    OBJ_LIST,
+    OBJ_NATIVE,
     OBJ_STRING,
 } ObjType;
 
@@ -13,21 +17,83 @@ struct Obj {
     struct Obj* next;
 };
 
+// Strings from source code are interned as they are created. Strings built
+// at runtime are not: most are printed once and dropped, so they are only
+// hashed, and interned, when something needs it.
+typedef enum {
+    STRING_UNHASHED,
+    STRING_HASHED,
+    STRING_INTERNED,  // the only string in this VM with these characters
+} StringState;
+
 struct ObjString {
     Obj obj;
     u32 length;
     char* chars;
-    u32 hash;
+    u32 hash;  // valid once the state is past STRING_UNHASHED
+    StringState state;
 };
 
-ObjString* takeString(char* chars, u32 length);
-ObjString* copyString(const char* chars, u32 length);
-void printObject(Value value);
+typedef struct {
+    Obj obj;
+    u32 arity;
+    Chunk chunk;
+    ObjString* name;  // NULL for the top-level script
+    struct RegisterCode* registers;  // only built for --registers
+    struct JitCode* jit;  // only built for --jit, NULL if unsupported
+} ObjFunction;
+
+// Items are stored inline in one contiguous array.
+typedef struct {
+    Obj obj;
+    ValueArray items;
+} ObjList;
+
+// A C function callable from Lox. It reads its arguments straight out of
+// the VM stack and stores its return value in *result. On failure it
+// reports a runtime error and returns false.
+typedef bool (*NativeFn)(VM* vm, u32 argCount, Value* args, Value* result);
+
+#define NATIVE_VARIADIC -1
+
+typedef struct {
+    Obj obj;
+    NativeFn function;
+    i32 arity;  // NATIVE_VARIADIC to accept any number of arguments
+    ObjString* name;
+} ObjNative;
+
+ObjFunction* newFunction(VM* vm);
+ObjNative* newNative(VM* vm, NativeFn function, i32 arity, ObjString* name);
+ObjList* newList(VM* vm, u32 capacity);
+void appendList(VM* vm, ObjList* list, Value value);
+// Takes ownership of `chars` for a runtime string, which starts out neither
+// hashed nor interned.
+ObjString* takeString(VM* vm, char* chars, u32 length);
+// Interns a copy of `chars`.
+ObjString* copyString(VM* vm, const char* chars, u32 length);
+ObjString* concatStrings(VM* vm, ObjString* a, ObjString* b);
+u32 stringHash(ObjString* string);
+// Interned strings match by identity; runtime strings compare their bytes.
+bool stringsEqual(ObjString* a, ObjString* b);
+void writeObject(OutputBuffer* output, Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
     return value.type == VAL_OBJ && value.as.obj->type == type;
 }
 
+static inline ObjFunction* functionFrom(Value value) {
+    return (ObjFunction*)value.as.obj;
+}
+
+static inline ObjNative* nativeFrom(Value value) {
+    return (ObjNative*)value.as.obj;
+}
+
+static inline ObjList* listFrom(Value value) {
+    return (ObjList*)value.as.obj;
+}
+
 static inline ObjString* stringFrom(Value value) {
     return (ObjString*)value.as.obj;
 }
@@ -0,0 +1,27 @@
+#include <string.h>
+
+#include "output.h"
+
+void initOutput(OutputBuffer* output, FILE* file) {
+    output->file = file;
+    output->count = 0;
+}
+
+void flushOutput(OutputBuffer* output) {
+    if (output->count == 0) return;
+    fwrite(output->data, 1, output->count, output->file);
+    output->count = 0;
+}
+
+void writeBytes(OutputBuffer* output, const char* bytes, u32 length) {
+    if (output->count + length > OUTPUT_BUFFER_SIZE) {
+        flushOutput(output);
+        // Anything this big goes straight through.
+        if (length > OUTPUT_BUFFER_SIZE) {
+            fwrite(bytes, 1, length, output->file);
+            return;
+        }
+    }
+    memcpy(output->data + output->count, bytes, length);
+    output->count += length;
+}
@@ -0,0 +1,28 @@
+#ifndef clox_output_h
+#define clox_output_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+#define OUTPUT_BUFFER_SIZE 8192
+
+// Program output collects here and reaches the FILE in large writes. The
+// VM flushes its buffer when it fills, when a script finishes and before
+// any error is reported, so stdout and stderr still interleave correctly.
+typedef struct {
+    FILE* file;
+    u32 count;
+    char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+
+void initOutput(OutputBuffer* output, FILE* file);
+void flushOutput(OutputBuffer* output);
+void writeBytes(OutputBuffer* output, const char* bytes, u32 length);
+
+static inline void writeChar(OutputBuffer* output, char c) {
+    if (output->count == OUTPUT_BUFFER_SIZE) flushOutput(output);
+    output->data[output->count++] = c;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "common.h"
+#include "perf_stats.h"
+
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_COUNT,
+} Counter;
+
+typedef struct {
+    u64 wallNanos;
+    u64 units;
+    bool unitsUnknown;  // some run went uncounted, so no per-unit rates
+    u64 counts[COUNTER_COUNT];
+    u64 startNanos;
+} PhaseStats;
+
+bool perfStatsEnabled = false;
+
+static const char* counterNames[COUNTER_COUNT] = {
+    [COUNTER_CYCLES]        = "cycles",
+    [COUNTER_INSTRUCTIONS]  = "instructions",
+    [COUNTER_BRANCH_MISSES] = "branch-misses",
+    [COUNTER_L1D_MISSES]    = "L1d-misses",
+    [COUNTER_LLC_MISSES]    = "LLC-misses",
+};
+
+// -1 marks a counter the kernel refused to open; it is left out of the report.
+static int counterFds[COUNTER_COUNT];
+static PhaseStats phases[PHASE_COUNT];
+
+static u64 nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000u + (u64)now.tv_nsec;
+}
+
+#ifdef __linux__
+static int openCounter(u32 type, u64 config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void openCounters() {
+    counterFds[COUNTER_CYCLES] =
+        openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counterFds[COUNTER_INSTRUCTIONS] =
+        openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counterFds[COUNTER_BRANCH_MISSES] =
+        openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    counterFds[COUNTER_L1D_MISSES] =
+        openCounter(PERF_TYPE_HW_CACHE,
+                    PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counterFds[COUNTER_LLC_MISSES] =
+        openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+
+static void startCounters() {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counterFds[i] < 0) continue;
+        ioctl(counterFds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counterFds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static void stopCounters(PhaseStats* stats) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counterFds[i] < 0) continue;
+        ioctl(counterFds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        u64 count;
+        if (read(counterFds[i], &count, sizeof(count)) == sizeof(count)) {
+            stats->counts[i] += count;
+        }
+    }
+}
+
+static void closeCounters() {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counterFds[i] >= 0) close(counterFds[i]);
+        counterFds[i] = -1;
+    }
+}
+#else
+static void openCounters() {
+    for (int i = 0; i < COUNTER_COUNT; i++) counterFds[i] = -1;
+}
+static void startCounters() {}
+static void stopCounters(PhaseStats* stats) { (void)stats; }
+static void closeCounters() {}
+#endif
+
+void perfPhaseBegin(PerfPhase phase) {
+    phases[phase].startNanos = nowNanos();
+    startCounters();
+}
+
+void perfPhaseEnd(PerfPhase phase, u64 units) {
+    stopCounters(&phases[phase]);
+    phases[phase].wallNanos += nowNanos() - phases[phase].startNanos;
+    if (units == PERF_UNITS_UNKNOWN) {
+        phases[phase].unitsUnknown = true;
+    } else {
+        phases[phase].units += units;
+    }
+}
+
+static void printPhase(const char* name, const char* unitName,
+                       const PhaseStats* stats) {
+    if (stats->unitsUnknown) {
+        fprintf(stderr, "-- %s: %.3f ms, n/a %ss --\n",
+                name, stats->wallNanos / 1e6, unitName);
+    } else {
+        fprintf(stderr, "-- %s: %.3f ms, %" U64_FMT " %s --\n",
+                name, stats->wallNanos / 1e6, stats->units, unitName);
+    }
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counterFds[i] < 0) continue;
+        fprintf(stderr, "%-14s %14" U64_FMT, counterNames[i], stats->counts[i]);
+        if (stats->unitsUnknown) {
+            fprintf(stderr, "  %10s per %s", "n/a", unitName);
+        } else if (stats->units > 0) {
+            fprintf(stderr, "  %10.2f per %s",
+                    (f64)stats->counts[i] / stats->units, unitName);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    if (counterFds[COUNTER_CYCLES] >= 0 &&
+        counterFds[COUNTER_INSTRUCTIONS] >= 0 &&
+        stats->counts[COUNTER_CYCLES] > 0) {
+        fprintf(stderr, "%-14s %14.2f\n", "IPC",
+                (f64)stats->counts[COUNTER_INSTRUCTIONS] /
+                stats->counts[COUNTER_CYCLES]);
+    }
+}
+
+static void printPerfStats() {
+    bool anyCounter = false;
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counterFds[i] >= 0) anyCounter = true;
+    }
+
+    fprintf(stderr, "== perf stats ==\n");
+    if (!anyCounter) {
+        fprintf(stderr,
+                "hardware counters unavailable, reporting wall time only\n");
+    }
+    printPhase("compile", "byte", &phases[PHASE_COMPILE]);
+    printPhase("run", "op", &phases[PHASE_RUN]);
+
+    closeCounters();
+}
+
+void enablePerfStats() {
+    if (perfStatsEnabled) return;
+    perfStatsEnabled = true;
+    openCounters();
+    atexit(printPerfStats);
+}
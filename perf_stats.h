@@ -0,0 +1,22 @@
+#ifndef clox_perf_stats_h
+#define clox_perf_stats_h
+
+#include "common.h"
+
+typedef enum {
+    PHASE_COMPILE,
+    PHASE_RUN,
+    PHASE_COUNT,
+} PerfPhase;
+
+extern bool perfStatsEnabled;
+
+void enablePerfStats(void);
+void perfPhaseBegin(PerfPhase phase);
+// units is the work done in the phase: bytecode bytes emitted for
+// PHASE_COMPILE, instructions dispatched for PHASE_RUN. Pass
+// PERF_UNITS_UNKNOWN when that was not counted.
+#define PERF_UNITS_UNKNOWN U64_MAX
+void perfPhaseEnd(PerfPhase phase, u64 units);
+
+#endif
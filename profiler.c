@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common.h"
+#include "debug.h"
+#include "profiler.h"
+
+#ifdef PROFILE_OPCODES
+
+#define OPCODE_SLOTS (U8_MAX + 1)
+#define TOP_PAIRS 20
+
+typedef struct {
+    u64 count;
+    u64 cycles;
+} OpStats;
+
+typedef struct {
+    u8 first;
+    u8 second;
+    u64 count;
+} OpPair;
+
+bool profilerEnabled = false;
+
+static OpStats opStats[OPCODE_SLOTS];
+static u64 pairCounts[OPCODE_SLOTS][OPCODE_SLOTS];
+static i32 previousOp = -1;
+static u64 previousStart;
+
+static inline u64 readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    u32 lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000u + (u64)now.tv_nsec;
+#endif
+}
+
+// Each instruction is charged the time from its own dispatch to the next one,
+// so the cost of the dispatch itself is folded into the preceding opcode.
+void profileInstruction(u8 instruction) {
+    u64 now = readCycles();
+    if (previousOp >= 0) {
+        opStats[previousOp].cycles += now - previousStart;
+        pairCounts[previousOp][instruction]++;
+    }
+
+    opStats[instruction].count++;
+    previousOp = instruction;
+    previousStart = readCycles();
+}
+
+void profileBegin() {
+    previousOp = -1;
+}
+
+void profileEnd() {
+    if (previousOp >= 0) {
+        opStats[previousOp].cycles += readCycles() - previousStart;
+    }
+    previousOp = -1;
+}
+
+static const char* nameOf(u8 instruction) {
+    const char* name = opcodeName(instruction);
+    return name != NULL ? name : "OP_UNKNOWN";
+}
+
+static int compareByCycles(const void* a, const void* b) {
+    u64 lhs = opStats[*(const u8*)a].cycles;
+    u64 rhs = opStats[*(const u8*)b].cycles;
+    return (lhs < rhs) - (lhs > rhs);
+}
+
+static int compareByCount(const void* a, const void* b) {
+    u64 lhs = ((const OpPair*)a)->count;
+    u64 rhs = ((const OpPair*)b)->count;
+    return (lhs < rhs) - (lhs > rhs);
+}
+
+static void printProfile() {
+    u8 ops[OPCODE_SLOTS];
+    u32 opCount = 0;
+    u64 totalCount = 0;
+    u64 totalCycles = 0;
+    for (u32 op = 0; op < OPCODE_SLOTS; op++) {
+        if (opStats[op].count == 0) continue;
+        ops[opCount++] = (u8)op;
+        totalCount += opStats[op].count;
+        totalCycles += opStats[op].cycles;
+    }
+    if (totalCount == 0) return;
+
+    qsort(ops, opCount, sizeof(u8), compareByCycles);
+
+    fprintf(stderr, "== opcode profile ==\n");
+    fprintf(stderr, "%-18s %12s %14s %10s %7s\n",
+            "opcode", "count", "cycles", "cyc/op", "time%");
+    for (u32 i = 0; i < opCount; i++) {
+        OpStats* stats = &opStats[ops[i]];
+        fprintf(stderr, "%-18s %12" U64_FMT " %14" U64_FMT " %10.1f %6.2f%%\n",
+                nameOf(ops[i]), stats->count, stats->cycles,
+                (f64)stats->cycles / (f64)stats->count,
+                totalCycles ? 100.0 * stats->cycles / totalCycles : 0.0);
+    }
+    fprintf(stderr, "%-18s %12" U64_FMT " %14" U64_FMT "\n",
+            "total", totalCount, totalCycles);
+
+    // Hot adjacent pairs are the candidates for superinstructions.
+    OpPair pairs[TOP_PAIRS];
+    u32 pairCount = 0;
+    for (u32 i = 0; i < opCount; i++) {
+        for (u32 j = 0; j < opCount; j++) {
+            u64 count = pairCounts[ops[i]][ops[j]];
+            if (count == 0) continue;
+
+            OpPair pair = {.first = ops[i], .second = ops[j], .count = count};
+            if (pairCount < TOP_PAIRS) {
+                pairs[pairCount++] = pair;
+            } else if (pairs[TOP_PAIRS-1].count < count) {
+                pairs[TOP_PAIRS-1] = pair;
+            } else {
+                continue;
+            }
+            qsort(pairs, pairCount, sizeof(OpPair), compareByCount);
+        }
+    }
+
+    fprintf(stderr, "== opcode pairs ==\n");
+    for (u32 i = 0; i < pairCount; i++) {
+        fprintf(stderr, "%-18s -> %-18s %12" U64_FMT " %6.2f%%\n",
+                nameOf(pairs[i].first), nameOf(pairs[i].second),
+                pairs[i].count, 100.0 * pairs[i].count / totalCount);
+    }
+}
+
+void enableProfiler() {
+    if (profilerEnabled) return;
+    profilerEnabled = true;
+    atexit(printProfile);
+}
+
+#endif
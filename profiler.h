@@ -0,0 +1,17 @@
+#ifndef clox_profiler_h
+#define clox_profiler_h
+
+#include "common.h"
+
+#ifdef PROFILE_OPCODES
+
+extern bool profilerEnabled;
+
+void enableProfiler(void);
+void profileBegin(void);
+void profileInstruction(u8 instruction);
+void profileEnd(void);
+
+#endif
+
+#endif
@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "chunk.h"
+#include "list_kernels.h"
+#include "memory.h"
+#include "register_code.h"
+#include "value.h"
+
+#define REGISTERS_MAX (U8_MAX + 1)
+#define NO_RESULT U32_MAX
+
+typedef struct {
+    u32 pc;      // the word whose sBx is patched
+    u32 target;  // bytecode offset it jumps to
+} Patch;
+
+// The translator walks the bytecode once, simulating the operand stack.
+// Stack position i normally lives in register i, but a GET_LOCAL does not
+// copy: it records that position i reads straight from the local's register
+// instead, and the copy is only made if something needs the value in place
+// (a call's arguments, a jump, or a write to the local it aliases).
+typedef struct {
+    VM* vm;
+    Chunk* chunk;
+    RegisterCode* out;
+    u8 source[REGISTERS_MAX];  // register holding each stack position
+    u32 depth;
+    u32 maxDepth;
+    bool* isTarget;  // indexed by bytecode offset
+    i32* depthAt;    // stack depth at each jump target, -1 until known
+    u32* pcAt;       // register pc each bytecode offset starts at
+    Patch* patches;
+    u32 patchCount;
+    u32 patchCapacity;
+    u32 origin;      // bytecode offset being translated
+    u32 lastResult;  // pc of the last instruction that only wrote R[A]
+    bool failed;
+} Translator;
+
+static u32 emit(Translator* t, RegOpCode op, u32 a, u32 b, u32 c) {
+    RegisterCode* out = t->out;
+    if (out->capacity < out->count + 1) {
+        u32 oldCapacity = out->capacity;
+        out->capacity = GROW_CAPACITY(oldCapacity);
+        out->code = GROW_ARRAY(t->vm, RegInstr, out->code, oldCapacity,
+                               out->capacity, MEM_REGISTER_CODE);
+        out->origins = GROW_ARRAY(t->vm, u32, out->origins, oldCapacity,
+                                  out->capacity, MEM_REGISTER_CODE);
+    }
+
+    out->code[out->count] = (RegInstr)op | a << 8 | b << 16 | c << 24;
+    out->origins[out->count] = t->origin;
+    t->lastResult = NO_RESULT;
+    return out->count++;
+}
+
+// An instruction whose only effect is writing R[A], so a following store
+// to a local can retarget A instead of adding a move.
+static void emitResult(Translator* t, RegOpCode op, u32 a, u32 b, u32 c) {
+    t->lastResult = emit(t, op, a, b, c);
+}
+
+static void emitJumpTo(Translator* t, RegOpCode op, u32 a, u32 target) {
+    u32 pc = emit(t, op, a, 0, 0);
+    if (t->patchCapacity < t->patchCount + 1) {
+        u32 oldCapacity = t->patchCapacity;
+        t->patchCapacity = GROW_CAPACITY(oldCapacity);
+        t->patches = GROW_ARRAY(t->vm, Patch, t->patches, oldCapacity,
+                                t->patchCapacity, MEM_REGISTER_CODE);
+    }
+    t->patches[t->patchCount++] = (Patch){ .pc = pc, .target = target };
+
+    if (target > t->origin && t->depthAt[target] < 0) {
+        t->depthAt[target] = (i32)t->depth;
+    }
+}
+
+static u32 pushRegister(Translator* t, u8 reg) {
+    if (t->depth == REGISTERS_MAX) {
+        t->failed = true;
+        return 0;
+    }
+    u32 position = t->depth++;
+    t->source[position] = reg;
+    if (t->depth > t->maxDepth) t->maxDepth = t->depth;
+    return position;
+}
+
+// A fresh stack position that owns its register.
+static u32 pushTemp(Translator* t) {
+    return pushRegister(t, (u8)t->depth);
+}
+
+static u8 popSource(Translator* t) {
+    return t->source[--t->depth];
+}
+
+// Copies an aliased stack position into its own register.
+static void materialize(Translator* t, u32 position) {
+    if (t->source[position] == position) return;
+    emit(t, REG_MOVE, position, t->source[position], 0);
+    t->source[position] = (u8)position;
+}
+
+static void materializeFrom(Translator* t, u32 first) {
+    for (u32 position = first; position < t->depth; position++) {
+        materialize(t, position);
+    }
+}
+
+// Before register `reg` is overwritten, positions still reading the old
+// value get their own copy.
+static void detachAliases(Translator* t, u32 reg) {
+    for (u32 position = 0; position < t->depth; position++) {
+        if (position != reg && t->source[position] == reg) {
+            materialize(t, position);
+        }
+    }
+}
+
+static bool hasAliases(Translator* t, u32 reg) {
+    for (u32 position = 0; position < t->depth; position++) {
+        if (position != reg && t->source[position] == reg) return true;
+    }
+    return false;
+}
+
+static void getLocal(Translator* t, u8 slot) {
+    pushRegister(t, t->source[slot]);
+}
+
+static void setLocal(Translator* t, u8 slot) {
+    u32 value = t->depth - 1;
+    u8 from = t->source[value];
+    if (from == slot) return;
+
+    RegisterCode* out = t->out;
+    if (from == value && !hasAliases(t, slot) &&
+        t->lastResult != NO_RESULT && t->lastResult == out->count - 1 &&
+        REG_A(out->code[t->lastResult]) == value) {
+        // Compute straight into the local.
+        out->code[t->lastResult] =
+            (out->code[t->lastResult] & ~(RegInstr)0xff00) | (u32)slot << 8;
+    } else {
+        detachAliases(t, slot);
+        emit(t, REG_MOVE, slot, from, 0);
+    }
+    t->source[slot] = slot;
+    t->source[value] = slot;
+}
+
+static void binary(Translator* t, RegOpCode op) {
+    u8 b = popSource(t);
+    u8 a = popSource(t);
+    emitResult(t, op, pushTemp(t), a, b);
+}
+
+static void unary(Translator* t, RegOpCode op) {
+    u8 a = popSource(t);
+    emitResult(t, op, pushTemp(t), a, 0);
+}
+
+static u8 readByte(Translator* t, u32 offset) {
+    return t->chunk->code[offset + 1];
+}
+
+static u32 jumpTarget(Chunk* chunk, u32 offset) {
+    u16 jump = (u16)(chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    if (chunk->code[offset] == OP_LOOP) return offset + 3 - jump;
+    return offset + 3 + jump;
+}
+
+static bool isJump(u8 instruction) {
+    return instructionLength(instruction) == 3;
+}
+
+// Operands the instruction pops; the translator gives up rather than
+// underflow on bytecode it does not understand.
+static u32 stackInputs(Translator* t, u32 offset) {
+    u8 instruction = t->chunk->code[offset];
+    switch (instruction) {
+        case OP_POP:
+        case OP_SET_LOCAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_ADD_GLOBAL:
+        case OP_SUBTRACT_GLOBAL:
+        case OP_MULTIPLY_GLOBAL:
+        case OP_DIVIDE_GLOBAL:
+        case OP_JUMP_IF_FALSE:
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_LIST_LENGTH:
+        case OP_RETURN:
+        case OP_PRINT:
+            return 1;
+        case OP_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_EQUAL_NUM:
+        case OP_LESS_NUM:
+        case OP_GREATER_NUM:
+        case OP_ADD_NUM:
+        case OP_ADD_STR:
+        case OP_GET_INDEX:
+        case OP_LIST_APPEND:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL:
+            return 2;
+        case OP_SET_INDEX:
+            return 3;
+        case OP_POPN:
+        case OP_BUILD_LIST:
+            return readByte(t, offset);
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            return readByte(t, offset) + 1u;
+        case OP_LIST_KERNEL:
+            return listKernelArity((ListKernel)readByte(t, offset)) + 1;
+        default:
+            return 0;
+    }
+}
+
+// Translates one instruction. Returns false if control never falls through
+// to the next one.
+static bool translateInstruction(Translator* t, u32 offset) {
+    u8 instruction = t->chunk->code[offset];
+    switch (instruction) {
+        case OP_CONSTANT:
+            emitResult(t, REG_LOADK, pushTemp(t), readByte(t, offset), 0);
+            break;
+        case OP_NIL:   emitResult(t, REG_NIL, pushTemp(t), 0, 0); break;
+        case OP_TRUE:  emitResult(t, REG_TRUE, pushTemp(t), 0, 0); break;
+        case OP_FALSE: emitResult(t, REG_FALSE, pushTemp(t), 0, 0); break;
+        case OP_POP:   t->depth--; break;
+        case OP_POPN:  t->depth -= readByte(t, offset); break;
+        case OP_GET_LOCAL: getLocal(t, readByte(t, offset)); break;
+        case OP_SET_LOCAL: setLocal(t, readByte(t, offset)); break;
+        case OP_GET_GLOBAL:
+            emitResult(t, REG_GET_GLOBAL, pushTemp(t), readByte(t, offset), 0);
+            break;
+        case OP_DEFINE_GLOBAL:
+            emit(t, REG_DEFINE_GLOBAL, popSource(t), readByte(t, offset), 0);
+            break;
+        case OP_SET_GLOBAL:
+            emit(t, REG_SET_GLOBAL, t->source[t->depth - 1],
+                 readByte(t, offset), 0);
+            break;
+        case OP_ADD_GLOBAL:
+        case OP_SUBTRACT_GLOBAL:
+        case OP_MULTIPLY_GLOBAL:
+        case OP_DIVIDE_GLOBAL: {
+            static const u8 generic[] = {
+                [OP_ADD_GLOBAL] = OP_ADD,
+                [OP_SUBTRACT_GLOBAL] = OP_SUBTRACT,
+                [OP_MULTIPLY_GLOBAL] = OP_MULTIPLY,
+                [OP_DIVIDE_GLOBAL] = OP_DIVIDE,
+            };
+            // The operand register is also the result, so it must be ours.
+            materialize(t, t->depth - 1);
+            emit(t, REG_UPDATE_GLOBAL, t->depth - 1, readByte(t, offset),
+                 generic[instruction]);
+            break;
+        }
+        case OP_INC_GLOBAL:
+        case OP_DEC_GLOBAL:
+            emit(t, REG_STEP_GLOBAL, pushTemp(t), readByte(t, offset),
+                 instruction == OP_DEC_GLOBAL);
+            break;
+        case OP_INC_LOCAL:
+        case OP_DEC_LOCAL: {
+            u8 slot = readByte(t, offset);
+            materialize(t, slot);
+            detachAliases(t, slot);
+            emit(t, REG_STEP_LOCAL, pushTemp(t), slot,
+                 instruction == OP_DEC_LOCAL);
+            break;
+        }
+        case OP_JUMP:
+        case OP_LOOP:
+            materializeFrom(t, 0);
+            emitJumpTo(t, REG_JUMP, 0, jumpTarget(t->chunk, offset));
+            return false;
+        case OP_JUMP_IF_FALSE:
+            materializeFrom(t, 0);
+            emitJumpTo(t, REG_JUMP_IF_FALSE, t->depth - 1,
+                       jumpTarget(t->chunk, offset));
+            break;
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL: {
+            u8 b = popSource(t);
+            u8 a = popSource(t);
+            materializeFrom(t, 0);
+            emit(t, REG_COMPARE_JUMP, a, b, instruction);
+            emitJumpTo(t, REG_JUMP, 0, jumpTarget(t->chunk, offset));
+            break;
+        }
+        case OP_EQUAL:
+        case OP_EQUAL_NUM:   binary(t, REG_EQUAL); break;
+        case OP_LESS:
+        case OP_LESS_NUM:    binary(t, REG_LESS); break;
+        case OP_GREATER:
+        case OP_GREATER_NUM: binary(t, REG_GREATER); break;
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_STR:     binary(t, REG_ADD); break;
+        case OP_SUBTRACT:    binary(t, REG_SUBTRACT); break;
+        case OP_MULTIPLY:    binary(t, REG_MULTIPLY); break;
+        case OP_DIVIDE:      binary(t, REG_DIVIDE); break;
+        case OP_NOT:         unary(t, REG_NOT); break;
+        case OP_NEGATE:      unary(t, REG_NEGATE); break;
+        case OP_BUILD_LIST: {
+            u8 count = readByte(t, offset);
+            u32 base = t->depth - count;
+            materializeFrom(t, base);
+            t->depth = base;
+            emit(t, REG_BUILD_LIST, pushTemp(t), count, 0);
+            break;
+        }
+        case OP_GET_INDEX:   binary(t, REG_GET_INDEX); break;
+        case OP_SET_INDEX: {
+            u8 value = popSource(t);
+            u8 index = popSource(t);
+            u8 list = popSource(t);
+            emit(t, REG_SET_INDEX, list, index, value);
+            // A local's register can stand for the result; a temporary
+            // above the new top cannot, as it is free for reuse.
+            if (value < t->depth) {
+                pushRegister(t, value);
+            } else {
+                emit(t, REG_MOVE, pushTemp(t), value, 0);
+            }
+            break;
+        }
+        case OP_LIST_LENGTH: unary(t, REG_LIST_LENGTH); break;
+        case OP_LIST_APPEND: {
+            u8 value = popSource(t);
+            u8 list = popSource(t);
+            emit(t, REG_LIST_APPEND, list, value, 0);
+            emit(t, REG_NIL, pushTemp(t), 0, 0);
+            break;
+        }
+        case OP_LIST_KERNEL: {
+            ListKernel kernel = (ListKernel)readByte(t, offset);
+            u32 base = t->depth - listKernelArity(kernel) - 1;
+            materializeFrom(t, base);
+            emit(t, REG_LIST_KERNEL, base, kernel, 0);
+            t->depth = base + 1;
+            break;
+        }
+        case OP_CALL:
+        case OP_TAIL_CALL: {
+            u8 argCount = readByte(t, offset);
+            u32 base = t->depth - argCount - 1;
+            // The callee's frame starts at `base`. Registers below it are
+            // out of the callee's reach, so aliases there stay valid.
+            materializeFrom(t, base);
+            emit(t, instruction == OP_CALL ? REG_CALL : REG_TAIL_CALL, base,
+                 argCount, 0);
+            t->depth = base + 1;
+            break;
+        }
+        case OP_RETURN:
+            emit(t, REG_RETURN, popSource(t), 0, 0);
+            return false;
+        case OP_PRINT:
+            emit(t, REG_PRINT, popSource(t), 0, 0);
+            break;
+        default:
+            t->failed = true;
+            break;
+    }
+    return true;
+}
+
+static void translateChunk(Translator* t) {
+    Chunk* chunk = t->chunk;
+
+    for (u32 offset = 0; offset < chunk->count;
+         offset += instructionLength(chunk->code[offset])) {
+        if (isJump(chunk->code[offset])) {
+            t->isTarget[jumpTarget(chunk, offset)] = true;
+        }
+    }
+
+    bool reachable = true;
+    for (u32 offset = 0; offset < chunk->count && !t->failed;
+         offset += instructionLength(chunk->code[offset])) {
+        t->origin = offset;
+        if (t->isTarget[offset]) {
+            // Every path into a label leaves each stack position in its own
+            // register.
+            if (reachable) {
+                materializeFrom(t, 0);
+            } else if (t->depthAt[offset] >= 0) {
+                t->depth = (u32)t->depthAt[offset];
+            }
+            for (u32 position = 0; position < t->depth; position++) {
+                t->source[position] = (u8)position;
+            }
+            t->lastResult = NO_RESULT;
+        }
+        t->pcAt[offset] = t->out->count;
+
+        if (stackInputs(t, offset) > t->depth) {
+            t->failed = true;
+            break;
+        }
+        reachable = translateInstruction(t, offset);
+    }
+    t->pcAt[chunk->count] = t->out->count;
+
+    for (u32 i = 0; i < t->patchCount && !t->failed; i++) {
+        Patch* patch = &t->patches[i];
+        i32 jump = (i32)t->pcAt[patch->target] - (i32)(patch->pc + 1);
+        if (jump < I16_MIN || jump > I16_MAX) {
+            t->failed = true;
+            break;
+        }
+        RegInstr* instr = &t->out->code[patch->pc];
+        *instr = (*instr & 0xffff) | (RegInstr)(u16)jump << 16;
+    }
+}
+
+bool translateFunction(VM* vm, ObjFunction* function) {
+    if (function->registers != NULL) return true;
+
+    Chunk* chunk = &function->chunk;
+    RegisterCode* code = ALLOCATE(vm, RegisterCode, 1, MEM_REGISTER_CODE);
+    code->code = NULL;
+    code->origins = NULL;
+    code->count = 0;
+    code->capacity = 0;
+
+    Translator t;
+    t.vm = vm;
+    t.chunk = chunk;
+    t.out = code;
+    t.depth = 0;
+    t.maxDepth = 0;
+    t.patches = NULL;
+    t.patchCount = 0;
+    t.patchCapacity = 0;
+    t.lastResult = NO_RESULT;
+    t.failed = false;
+    t.isTarget = ALLOCATE(vm, bool, chunk->count + 1, MEM_REGISTER_CODE);
+    t.depthAt = ALLOCATE(vm, i32, chunk->count + 1, MEM_REGISTER_CODE);
+    t.pcAt = ALLOCATE(vm, u32, chunk->count + 1, MEM_REGISTER_CODE);
+    for (u32 i = 0; i <= chunk->count; i++) {
+        t.isTarget[i] = false;
+        t.depthAt[i] = -1;
+    }
+
+    // Slot 0 holds the callee, then come the parameters.
+    for (u32 slot = 0; slot <= function->arity; slot++) pushTemp(&t);
+    translateChunk(&t);
+    code->frameSize = t.maxDepth;
+
+    FREE_ARRAY(vm, bool, t.isTarget, chunk->count + 1, MEM_REGISTER_CODE);
+    FREE_ARRAY(vm, i32, t.depthAt, chunk->count + 1, MEM_REGISTER_CODE);
+    FREE_ARRAY(vm, u32, t.pcAt, chunk->count + 1, MEM_REGISTER_CODE);
+    FREE_ARRAY(vm, Patch, t.patches, t.patchCapacity, MEM_REGISTER_CODE);
+
+    if (t.failed) {
+        freeRegisterCode(vm, code);
+        return false;
+    }
+    function->registers = code;
+
+    // Functions are only ever created as constants of their enclosing
+    // chunk, so this reaches every function in the program.
+    for (u32 i = 0; i < chunk->constants.count; i++) {
+        Value constant = chunk->constants.values[i];
+        if (isObjType(constant, OBJ_FUNCTION) &&
+            !translateFunction(vm, functionFrom(constant))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void freeRegisterCode(VM* vm, RegisterCode* code) {
+    FREE_ARRAY(vm, RegInstr, code->code, code->capacity, MEM_REGISTER_CODE);
+    FREE_ARRAY(vm, u32, code->origins, code->capacity, MEM_REGISTER_CODE);
+    FREE(vm, RegisterCode, code, MEM_REGISTER_CODE);
+}
+
+static const char* regOpName(u8 op) {
+    switch (op) {
+        case REG_MOVE: return "MOVE";
+        case REG_LOADK: return "LOADK";
+        case REG_NIL: return "NIL";
+        case REG_TRUE: return "TRUE";
+        case REG_FALSE: return "FALSE";
+        case REG_GET_GLOBAL: return "GET_GLOBAL";
+        case REG_DEFINE_GLOBAL: return "DEFINE_GLOBAL";
+        case REG_SET_GLOBAL: return "SET_GLOBAL";
+        case REG_UPDATE_GLOBAL: return "UPDATE_GLOBAL";
+        case REG_STEP_GLOBAL: return "STEP_GLOBAL";
+        case REG_STEP_LOCAL: return "STEP_LOCAL";
+        case REG_EQUAL: return "EQUAL";
+        case REG_LESS: return "LESS";
+        case REG_GREATER: return "GREATER";
+        case REG_ADD: return "ADD";
+        case REG_SUBTRACT: return "SUBTRACT";
+        case REG_MULTIPLY: return "MULTIPLY";
+        case REG_DIVIDE: return "DIVIDE";
+        case REG_NOT: return "NOT";
+        case REG_NEGATE: return "NEGATE";
+        case REG_JUMP: return "JUMP";
+        case REG_JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+        case REG_COMPARE_JUMP: return "COMPARE_JUMP";
+        case REG_BUILD_LIST: return "BUILD_LIST";
+        case REG_GET_INDEX: return "GET_INDEX";
+        case REG_SET_INDEX: return "SET_INDEX";
+        case REG_LIST_LENGTH: return "LIST_LENGTH";
+        case REG_LIST_APPEND: return "LIST_APPEND";
+        case REG_LIST_KERNEL: return "LIST_KERNEL";
+        case REG_CALL: return "CALL";
+        case REG_TAIL_CALL: return "TAIL_CALL";
+        case REG_RETURN: return "RETURN";
+        case REG_PRINT: return "PRINT";
+        default: return "?";
+    }
+}
+
+void disassembleRegisterCode(FILE* out, const RegisterCode* code,
+                             const char* name) {
+    fprintf(out, "== %s (registers: %u) ==\n", name, code->frameSize);
+
+    for (u32 pc = 0; pc < code->count; pc++) {
+        RegInstr instr = code->code[pc];
+        fprintf(out, "%04u %4u %-14s", pc, code->origins[pc],
+                regOpName(REG_OP(instr)));
+        switch (REG_OP(instr)) {
+            case REG_JUMP:
+                fprintf(out, "      -> %d\n", (i32)pc + 1 + REG_SBX(instr));
+                break;
+            case REG_JUMP_IF_FALSE:
+                fprintf(out, " %3u  -> %d\n", REG_A(instr),
+                        (i32)pc + 1 + REG_SBX(instr));
+                break;
+            case REG_COMPARE_JUMP: {
+                RegInstr jump = code->code[++pc];
+                fprintf(out, " %3u %3u %3u -> %d\n", REG_A(instr),
+                        REG_B(instr), REG_C(instr),
+                        (i32)pc + 1 + REG_SBX(jump));
+                break;
+            }
+            default:
+                fprintf(out, " %3u %3u %3u\n", REG_A(instr), REG_B(instr),
+                        REG_C(instr));
+                break;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef clox_register_code_h
+#define clox_register_code_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+// Three-address code for the optional register backend (--registers).
+//
+// Each instruction is one 32-bit word: opcode, then operands A, B and C of
+// a byte each. Registers are the slots of the call frame's stack window,
+// so register i of a frame is frame->slots[i] and locals keep the slot
+// numbers the compiler gave them. Jumps take a signed 16-bit offset, in
+// instructions, in place of B and C.
+typedef u32 RegInstr;
+
+#define REG_OP(instr)  ((instr) & 0xff)
+#define REG_A(instr)   (((instr) >> 8) & 0xff)
+#define REG_B(instr)   (((instr) >> 16) & 0xff)
+#define REG_C(instr)   ((instr) >> 24)
+#define REG_SBX(instr) ((i16)((instr) >> 16))
+
+typedef enum {
+    REG_MOVE,           // R[A] = R[B]
+    REG_LOADK,          // R[A] = K[B]
+    REG_NIL,            // R[A] = nil
+    REG_TRUE,           // R[A] = true
+    REG_FALSE,          // R[A] = false
+    REG_GET_GLOBAL,     // R[A] = globals[K[B]]
+    REG_DEFINE_GLOBAL,  // globals[K[B]] = R[A], defining it
+    REG_SET_GLOBAL,     // globals[K[B]] = R[A]
+    REG_UPDATE_GLOBAL,  // R[A] = (globals[K[B]] C= R[A]), C an OpCode
+    REG_STEP_GLOBAL,    // R[A] = (globals[K[B]] += C ? -1 : 1)
+    REG_STEP_LOCAL,     // R[A] = (R[B] += C ? -1 : 1)
+    REG_EQUAL,          // R[A] = R[B] == R[C]
+    REG_LESS,           // R[A] = R[B] < R[C]
+    REG_GREATER,        // R[A] = R[B] > R[C]
+    REG_ADD,            // R[A] = R[B] + R[C]
+    REG_SUBTRACT,       // R[A] = R[B] - R[C]
+    REG_MULTIPLY,       // R[A] = R[B] * R[C]
+    REG_DIVIDE,         // R[A] = R[B] / R[C]
+    REG_NOT,            // R[A] = not R[B]
+    REG_NEGATE,         // R[A] = -R[B]
+    REG_JUMP,           // pc += sBx
+    REG_JUMP_IF_FALSE,  // if not R[A]: pc += sBx
+    // if not (R[A] C R[B]): pc += the sBx of the next word. C is one of the
+    // fused OP_JUMP_IF_* opcodes, which name the condition.
+    REG_COMPARE_JUMP,
+    REG_BUILD_LIST,     // R[A] = [R[A], ..., R[A+B-1]]
+    REG_GET_INDEX,      // R[A] = R[B][R[C]]
+    REG_SET_INDEX,      // R[A][R[B]] = R[C]
+    REG_LIST_LENGTH,    // R[A] = R[B].length
+    REG_LIST_APPEND,    // R[A].append(R[B])
+    REG_LIST_KERNEL,    // R[A] = kernel B over R[A] (and argument R[A+1])
+    REG_CALL,           // R[A] = R[A](R[A+1], ..., R[A+B])
+    REG_TAIL_CALL,      // return R[A](R[A+1], ..., R[A+B])
+    REG_RETURN,         // return R[A]
+    REG_PRINT,          // print R[A]
+} RegOpCode;
+
+typedef struct RegisterCode {
+    RegInstr* code;
+    u32* origins;    // bytecode offset each instruction was translated from
+    u32 count;
+    u32 capacity;
+    u32 frameSize;   // registers the frame needs
+} RegisterCode;
+
+// Translates a function's bytecode. Returns false, leaving no register code
+// behind, if the function needs more registers than an operand can name.
+bool translateFunction(VM* vm, ObjFunction* function);
+void freeRegisterCode(VM* vm, RegisterCode* code);
+void disassembleRegisterCode(FILE* out, const RegisterCode* code,
+                             const char* name);
+
+#endif
@@ -3,13 +3,7 @@
 
 #include "common.h"
 #include "memory.h"
-
-typedef struct { u32 line, len; } Run;
-typedef struct {
-    Run* runs; 
-    u32 capacity; 
-    u32 count;
-} RunTable;
+#include "run_table.h"
 
 void initRunTable(RunTable* runTable) {
     runTable->runs = NULL;
@@ -17,7 +11,7 @@ void initRunTable(RunTable* runTable) {
     runTable->count = 0;
 }
 
-void appendRunTable(RunTable* runTable, u32 line) {
+void appendRunTable(VM* vm, RunTable* runTable, u32 line) {
     if (runTable->count > 0 && 
         runTable->runs[runTable->count-1].line == line) {
         runTable->runs[runTable->count-1].len++;
@@ -28,16 +22,35 @@ void appendRunTable(RunTable* runTable, u32 line) {
     if (runTable->capacity <= runTable->count) {
         u32 oldCapacity = runTable->capacity;
         runTable->capacity = GROW_CAPACITY(oldCapacity);
-        runTable->runs = GROW_ARRAY(
-            Run, runTable->runs, oldCapacity, runTable->capacity
+        runTable->runs = GROW_ARRAY(vm,
+            Run, runTable->runs, oldCapacity, runTable->capacity,
+            MEM_RUN_TABLE
         );
     }
 
     Run run = {.line = line, .len = 1}; 
     runTable->runs[runTable->count++] = run;
 }
-void freeRunTable(RunTable* runTable) {
-    FREE_ARRAY(Run, runTable->runs, runTable->capacity);
+// Forget the lines of every instruction byte past instrCount.
+void truncateRunTable(RunTable* runTable, u32 instrCount) {
+    u32 total = 0;
+    for (u32 i = 0; i < runTable->count; i++) total += runTable->runs[i].len;
+
+    while (total > instrCount && runTable->count > 0) {
+        Run* last = &runTable->runs[runTable->count-1];
+        u32 excess = total - instrCount;
+        if (last->len > excess) {
+            last->len -= excess;
+            return;
+        }
+
+        total -= last->len;
+        runTable->count--;
+    }
+}
+
+void freeRunTable(VM* vm, RunTable* runTable) {
+    FREE_ARRAY(vm, Run, runTable->runs, runTable->capacity, MEM_RUN_TABLE);
     initRunTable(runTable);
 }
 
@@ -11,10 +11,11 @@ typedef struct {
 } RunTable;
 
 void initRunTable(RunTable* runTable);
-void appendRunTable(RunTable* runTable, u32 line);
-void freeRunTable(RunTable* runTable);
-void printRunTable(RunTable* runTable);
+void appendRunTable(VM* vm, RunTable* runTable, u32 line);
+void freeRunTable(VM* vm, RunTable* runTable);
+void truncateRunTable(RunTable* runTable, u32 instrCount);
+void printRunTable(const RunTable* runTable);
 
-u32 getLine(RunTable* runTable, u32 instrIndex);
+u32 getLine(const RunTable* runTable, u32 instrIndex);
 
 #endif
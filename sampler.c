@@ -0,0 +1,305 @@
+#define _XOPEN_SOURCE 700
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "chunk.h"
+#include "common.h"
+#include "object.h"
+#include "run_table.h"
+#include "sampler.h"
+#include "vm.h"
+
+#define SAMPLE_INTERVAL_USEC 1000
+
+// Fixed-size storage the signal handler can fill without allocating.
+// Samples that find both full are counted in droppedSamples.
+#define STACK_TABLE_SIZE 4096  // a power of two
+#define FRAME_POOL_SIZE (64 * 1024)
+
+// One distinct call stack seen during a run: the chunks of its frames,
+// outermost first, and the line the innermost frame was on.
+typedef struct {
+    u32 hash;
+    u32 start;  // into framePool
+    u32 depth;
+    u32 line;
+    u64 samples;  // 0 for an empty slot
+} StackSamples;
+
+// A call stack that outlives its run, as the folded text for it.
+typedef struct {
+    char* stack;  // "script;outer;inner:line"
+    u64 samples;
+} FoldedStack;
+
+bool samplerEnabled = false;
+
+static const char* foldedPath;
+
+// Written by the signal handler. A sample is charged to the stack of
+// functions the VM's frames are in, and the line of the bytecode the
+// innermost frame's ip points past. It goes to idleSamples if no chunk is
+// running. Only one VM is sampled at a time: the first to enter run().
+static VM* volatile activeVM = NULL;
+static ObjFunction** volatile activeFunctions = NULL;
+static volatile u32 activeCount = 0;
+static volatile u64 idleSamples = 0;
+static volatile u64 droppedSamples = 0;
+
+static StackSamples stackTable[STACK_TABLE_SIZE];
+static u32 framePool[FRAME_POOL_SIZE];
+static u32 framePoolCount = 0;
+
+// Merged across runs, for the report at exit.
+static FoldedStack* foldedStacks = NULL;
+static u32 foldedCount = 0;
+static u32 foldedCapacity = 0;
+
+// Index of the function whose code `ip` points into, or activeCount.
+static u32 findFunction(u8* ip) {
+    ObjFunction** functions = activeFunctions;
+    for (u32 i = 0; i < activeCount; i++) {
+        Chunk* chunk = &functions[i]->chunk;
+        if (ip > chunk->code && ip <= chunk->code + chunk->count) return i;
+    }
+    return activeCount;
+}
+
+static u32 hashStack(const u32* frames, u32 depth, u32 line) {
+    u32 hash = 2166136261u ^ line;
+    for (u32 i = 0; i < depth; i++) {
+        hash ^= frames[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static void recordStack(const u32* frames, u32 depth, u32 line) {
+    u32 hash = hashStack(frames, depth, line);
+    for (u32 probe = 0; probe < STACK_TABLE_SIZE; probe++) {
+        StackSamples* entry =
+            &stackTable[(hash + probe) & (STACK_TABLE_SIZE - 1)];
+        if (entry->samples == 0) {
+            if (framePoolCount + depth > FRAME_POOL_SIZE) break;
+            memcpy(&framePool[framePoolCount], frames, sizeof(u32) * depth);
+            *entry = (StackSamples){hash, framePoolCount, depth, line, 1};
+            framePoolCount += depth;
+            return;
+        }
+        if (entry->hash == hash && entry->depth == depth &&
+            entry->line == line &&
+            memcmp(&framePool[entry->start], frames,
+                   sizeof(u32) * depth) == 0) {
+            entry->samples++;
+            return;
+        }
+    }
+    droppedSamples++;
+}
+
+static void onSample(int signal) {
+    (void)signal;
+    VM* vm = activeVM;
+    u32 frameCount = vm != NULL ? vm->frameCount : 0;
+    if (frameCount == 0 || frameCount > FRAMES_MAX) {
+        idleSamples++;
+        return;
+    }
+
+    // A frame may be mid-update; only trust an ip inside a known chunk.
+    u8* ip = vm->frames[frameCount - 1].ip;
+    u32 leaf = findFunction(ip);
+    if (leaf == activeCount) {
+        idleSamples++;
+        return;
+    }
+    Chunk* chunk = &activeFunctions[leaf]->chunk;
+    u32 line = getLine(&chunk->runTable, (u32)(ip - chunk->code - 1));
+
+    u32 frames[FRAMES_MAX];
+    u32 depth = 0;
+    for (u32 i = 0; i < frameCount - 1; i++) {
+        u32 index = findFunction(vm->frames[i].ip);
+        if (index != activeCount) frames[depth++] = index;
+    }
+    frames[depth++] = leaf;
+    recordStack(frames, depth, line);
+}
+
+static void addFoldedStack(char* stack, u64 samples) {
+    for (u32 i = 0; i < foldedCount; i++) {
+        if (strcmp(foldedStacks[i].stack, stack) == 0) {
+            foldedStacks[i].samples += samples;
+            free(stack);
+            return;
+        }
+    }
+    if (foldedCapacity <= foldedCount) {
+        foldedCapacity = foldedCapacity < 64 ? 64 : foldedCapacity * 2;
+        foldedStacks = realloc(foldedStacks,
+                               sizeof(FoldedStack) * foldedCapacity);
+        if (foldedStacks == NULL) exit(SYSERR);
+    }
+    foldedStacks[foldedCount++] = (FoldedStack){stack, samples};
+}
+
+static const char* functionName(ObjFunction* function) {
+    return function->name != NULL ? function->name->chars : "script";
+}
+
+// Every function is compiled before the script starts running, so the set
+// of chunks to sample is fixed for the whole run.
+void beginSampling(VM* vm) {
+    if (activeVM != NULL) return;
+
+    u32 count = 0;
+    for (Obj* object = vm->objects; object != NULL; object = object->next) {
+        if (object->type == OBJ_FUNCTION) count++;
+    }
+
+    ObjFunction** functions = malloc(sizeof(ObjFunction*) *
+                                     (count ? count : 1));
+    if (functions == NULL) exit(SYSERR);
+    count = 0;
+    for (Obj* object = vm->objects; object != NULL; object = object->next) {
+        if (object->type == OBJ_FUNCTION) {
+            functions[count++] = (ObjFunction*)object;
+        }
+    }
+
+    memset(stackTable, 0, sizeof(stackTable));
+    framePoolCount = 0;
+    activeFunctions = functions;
+    activeCount = count;
+    activeVM = vm;
+}
+
+// Spells out the run's stacks with function names while the functions are
+// still alive.
+void endSampling(VM* vm) {
+    if (activeVM != vm) return;
+
+    activeVM = NULL;
+    ObjFunction** functions = activeFunctions;
+    activeCount = 0;
+    activeFunctions = NULL;
+
+    for (u32 i = 0; i < STACK_TABLE_SIZE; i++) {
+        StackSamples* entry = &stackTable[i];
+        if (entry->samples == 0) continue;
+
+        const u32* frames = &framePool[entry->start];
+        usize length = 16;  // ":line" and the terminator
+        for (u32 f = 0; f < entry->depth; f++) {
+            length += strlen(functionName(functions[frames[f]])) + 1;
+        }
+        char* stack = malloc(length);
+        if (stack == NULL) exit(SYSERR);
+        usize used = 0;
+        for (u32 f = 0; f < entry->depth; f++) {
+            used += (usize)sprintf(stack + used, "%s%s", f > 0 ? ";" : "",
+                                   functionName(functions[frames[f]]));
+        }
+        sprintf(stack + used, ":%u", entry->line);
+        addFoldedStack(stack, entry->samples);
+    }
+
+    free(functions);
+}
+static int compareBySamples(const void* a, const void* b) {
+    u64 lhs = ((const FoldedStack*)a)->samples;
+    u64 rhs = ((const FoldedStack*)b)->samples;
+    return (lhs < rhs) - (lhs > rhs);
+}
+
+// The innermost "function:line" of a folded stack.
+static char* leafOf(char* stack) {
+    char* separator = strrchr(stack, ';');
+    return separator != NULL ? separator + 1 : stack;
+}
+
+static void writeSampleReport() {
+    struct itimerval off = {0};
+    setitimer(ITIMER_PROF, &off, NULL);
+
+    u64 total = idleSamples + droppedSamples;
+    for (u32 i = 0; i < foldedCount; i++) total += foldedStacks[i].samples;
+
+    // Collapsed stacks, "outer;inner:line count", for flamegraph.pl.
+    FILE* folded = fopen(foldedPath, "w");
+    if (folded == NULL) {
+        fprintf(stderr, "Could not open \"%s\" for writing.\n", foldedPath);
+    } else {
+        for (u32 i = 0; i < foldedCount; i++) {
+            fprintf(folded, "%s %" U64_FMT "\n", foldedStacks[i].stack,
+                    foldedStacks[i].samples);
+        }
+        if (idleSamples > 0) {
+            fprintf(folded, "[runtime] %" U64_FMT "\n", (u64)idleSamples);
+        }
+        if (droppedSamples > 0) {
+            fprintf(folded, "[dropped] %" U64_FMT "\n", (u64)droppedSamples);
+        }
+        fclose(folded);
+    }
+
+    // Self time per (function, line): the stacks merged by their leaf.
+    FoldedStack* hot = malloc(sizeof(FoldedStack) *
+                              (foldedCount ? foldedCount : 1));
+    if (hot == NULL) exit(SYSERR);
+    u32 hotCount = 0;
+    for (u32 i = 0; i < foldedCount; i++) {
+        char* leaf = leafOf(foldedStacks[i].stack);
+        u32 j = 0;
+        while (j < hotCount && strcmp(hot[j].stack, leaf) != 0) j++;
+        if (j == hotCount) hot[hotCount++] = (FoldedStack){leaf, 0};
+        hot[j].samples += foldedStacks[i].samples;
+    }
+    qsort(hot, hotCount, sizeof(FoldedStack), compareBySamples);
+
+    fprintf(stderr, "== line samples (%d us interval) ==\n",
+            SAMPLE_INTERVAL_USEC);
+    fprintf(stderr, "%-24s %10s %7s\n", "function:line", "samples", "time%");
+    for (u32 i = 0; i < hotCount; i++) {
+        fprintf(stderr, "%-24s %10" U64_FMT " %6.2f%%\n", hot[i].stack,
+                hot[i].samples, 100.0 * hot[i].samples / total);
+    }
+    fprintf(stderr, "%-24s %10" U64_FMT " %6.2f%%\n", "runtime",
+            (u64)idleSamples, total ? 100.0 * idleSamples / total : 0.0);
+    if (droppedSamples > 0) {
+        fprintf(stderr, "%-24s %10" U64_FMT " %6.2f%%\n", "dropped",
+                (u64)droppedSamples, 100.0 * droppedSamples / total);
+    }
+
+    free(hot);
+    for (u32 i = 0; i < foldedCount; i++) free(foldedStacks[i].stack);
+    free(foldedStacks);
+    foldedStacks = NULL;
+    foldedCount = 0;
+    foldedCapacity = 0;
+}
+
+void enableSampler(const char* outPath) {
+    if (samplerEnabled) return;
+    samplerEnabled = true;
+    foldedPath = outPath;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    struct itimerval interval = {
+        .it_interval = {.tv_sec = 0, .tv_usec = SAMPLE_INTERVAL_USEC},
+        .it_value = {.tv_sec = 0, .tv_usec = SAMPLE_INTERVAL_USEC},
+    };
+    setitimer(ITIMER_PROF, &interval, NULL);
+
+    atexit(writeSampleReport);
+}
@@ -0,0 +1,13 @@
+#ifndef clox_sampler_h
+#define clox_sampler_h
+
+#include "chunk.h"
+#include "common.h"
+
+extern bool samplerEnabled;
+
+void enableSampler(const char* outPath);
+void beginSampling(VM* vm);
+void endSampling(VM* vm);
+
+#endif
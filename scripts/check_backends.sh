@@ -0,0 +1,57 @@
+#!/bin/sh
+# Differential check: runs Lox programs on every backend and compares
+# their stdout and exit status with the stack interpreter's.
+#
+#   sh scripts/check_backends.sh [program.lox ...]
+#
+# With no arguments it runs scripts/*.lox. It builds its own copy of clox
+# with -DNO_DEBUG_OUTPUT, so traces don't get in the way.
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cp "$root"/*.c "$root"/*.h "$root"/makefile "$work"
+make -s -C "$work" CFLAGS="-O1 -std=c99 -DNO_DEBUG_OUTPUT" clox libclox.a \
+    || exit 1
+
+[ $# -gt 0 ] || set -- "$root"/scripts/*.lox
+
+failures=0
+for program; do
+    name=$(basename "$program" .lox)
+    "$work/clox" "$program" >"$work/$name.expected" 2>/dev/null
+    expected=$?
+
+    for backend in --registers --jit --emit-c; do
+        if [ $backend = --emit-c ]; then
+            if ! "$work/clox" --emit-c "$work/$name.c" "$program" ||
+               ! ${CC:-cc} -O1 -std=c99 -Wall -Wextra -Werror -I"$work" \
+                     -o "$work/$name" \
+                     "$work/$name.c" "$work/libclox.a" -pthread -lm; then
+                echo "FAIL $name $backend: could not build"
+                failures=$((failures + 1))
+                continue
+            fi
+            "$work/$name" >"$work/$name.got" 2>/dev/null
+        else
+            "$work/clox" $backend "$program" >"$work/$name.got" 2>/dev/null
+        fi
+        got=$?
+
+        if [ $got -ne $expected ]; then
+            echo "FAIL $name $backend: exit status $got, expected $expected"
+            failures=$((failures + 1))
+        elif ! cmp -s "$work/$name.expected" "$work/$name.got"; then
+            echo "FAIL $name $backend: output differs"
+            diff "$work/$name.expected" "$work/$name.got" | head -n 10
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+if [ $failures -gt 0 ]; then
+    echo "$failures backend mismatches"
+    exit 1
+fi
+echo "all backends agree on $# programs"
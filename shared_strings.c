@@ -0,0 +1,164 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "object.h"
+#include "shared_strings.h"
+
+#define STRIPE_BITS 6
+#define STRIPE_COUNT (1 << STRIPE_BITS)
+#define SHARED_MAX_LOAD 0.75
+
+// Tables are never resized in place. A grown table is published with a
+// release store and the old one is kept on a retired list, so a reader that
+// is still probing it never touches freed memory.
+typedef struct SlotTable {
+    struct SlotTable* retired;
+    u32 capacity;
+    ObjString* slots[];
+} SlotTable;
+
+typedef struct {
+    pthread_mutex_t lock;
+    SlotTable* table;
+    u32 count;
+} Stripe;
+
+static Stripe stripes[STRIPE_COUNT];
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+
+static void initStripes() {
+    for (u32 i = 0; i < STRIPE_COUNT; i++) {
+        pthread_mutex_init(&stripes[i].lock, NULL);
+        stripes[i].table = NULL;
+        stripes[i].count = 0;
+    }
+}
+
+void initSharedStrings() {
+    pthread_once(&initOnce, initStripes);
+}
+
+// The low bits of the hash pick the slot, so use the high bits for the
+// stripe to keep the two independent.
+static Stripe* stripeFor(u32 hash) {
+    return &stripes[hash >> (32 - STRIPE_BITS)];
+}
+
+static ObjString* probe(SlotTable* table, const char* chars, u32 length,
+                        u32 hash) {
+    if (table == NULL) return NULL;
+
+    for (u32 index = hash % table->capacity;;
+        index = (index + 1) % table->capacity) {
+        ObjString* key = __atomic_load_n(&table->slots[index],
+                                         __ATOMIC_ACQUIRE);
+        if (key == NULL) return NULL;
+        if (key->length == length && key->hash == hash &&
+            memcmp(key->chars, chars, length) == 0) {
+            return key;
+        }
+    }
+}
+
+ObjString* findSharedString(const char* chars, u32 length, u32 hash) {
+    Stripe* stripe = stripeFor(hash);
+    SlotTable* table = __atomic_load_n(&stripe->table, __ATOMIC_ACQUIRE);
+    return probe(table, chars, length, hash);
+}
+
+static SlotTable* newSlotTable(u32 capacity) {
+    SlotTable* table = calloc(1, sizeof(SlotTable) +
+                                 sizeof(ObjString*) * capacity);
+    if (table == NULL) exit(SYSERR);
+    table->capacity = capacity;
+    return table;
+}
+
+static void insertSlot(SlotTable* table, ObjString* string) {
+    u32 index = string->hash % table->capacity;
+    while (table->slots[index] != NULL) {
+        index = (index + 1) % table->capacity;
+    }
+    __atomic_store_n(&table->slots[index], string, __ATOMIC_RELEASE);
+}
+
+static void growStripe(Stripe* stripe) {
+    SlotTable* old = stripe->table;
+    u32 capacity = old == NULL ? 64 : old->capacity * 2;
+    SlotTable* table = newSlotTable(capacity);
+    if (old != NULL) {
+        for (u32 i = 0; i < old->capacity; i++) {
+            if (old->slots[i] != NULL) insertSlot(table, old->slots[i]);
+        }
+    }
+
+    table->retired = old;
+    __atomic_store_n(&stripe->table, table, __ATOMIC_RELEASE);
+}
+
+static ObjString* newSharedString(const char* chars, u32 length, u32 hash) {
+    ObjString* string = malloc(sizeof(ObjString));
+    char* heapChars = malloc(length + 1);
+    if (string == NULL || heapChars == NULL) exit(SYSERR);
+
+    memcpy(heapChars, chars, length);
+    heapChars[length] = '\0';
+    string->obj.type = OBJ_STRING;
+    string->obj.next = NULL;
+    string->length = length;
+    string->chars = heapChars;
+    string->hash = hash;
+    string->state = STRING_INTERNED;
+    return string;
+}
+
+ObjString* internSharedString(const char* chars, u32 length, u32 hash) {
+    ObjString* found = findSharedString(chars, length, hash);
+    if (found != NULL) return found;
+
+    Stripe* stripe = stripeFor(hash);
+    pthread_mutex_lock(&stripe->lock);
+
+    // Another thread may have won the race since the lock-free probe.
+    found = probe(stripe->table, chars, length, hash);
+    if (found == NULL) {
+        if (stripe->table == NULL ||
+            stripe->count + 1 > stripe->table->capacity * SHARED_MAX_LOAD) {
+            growStripe(stripe);
+        }
+        found = newSharedString(chars, length, hash);
+        insertSlot(stripe->table, found);
+        stripe->count++;
+    }
+
+    pthread_mutex_unlock(&stripe->lock);
+    return found;
+}
+
+void freeSharedStrings() {
+    for (u32 i = 0; i < STRIPE_COUNT; i++) {
+        Stripe* stripe = &stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+
+        SlotTable* table = stripe->table;
+        if (table != NULL) {
+            for (u32 slot = 0; slot < table->capacity; slot++) {
+                ObjString* string = table->slots[slot];
+                if (string == NULL) continue;
+                free(string->chars);
+                free(string);
+            }
+        }
+        while (table != NULL) {
+            SlotTable* retired = table->retired;
+            free(table);
+            table = retired;
+        }
+        stripe->table = NULL;
+        stripe->count = 0;
+
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
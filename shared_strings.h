@@ -0,0 +1,16 @@
+#ifndef clox_shared_strings_h
+#define clox_shared_strings_h
+
+#include "common.h"
+#include "object.h"
+
+// A process-wide intern table that VMs can opt into with vm->sharedStrings.
+// Lookups are lock-free; inserts take one of a set of striped locks. Shared
+// strings are immortal: they belong to no VM and are only released by
+// freeSharedStrings() once no VM is using them.
+void initSharedStrings(void);
+void freeSharedStrings(void);
+ObjString* findSharedString(const char* chars, u32 length, u32 hash);
+ObjString* internSharedString(const char* chars, u32 length, u32 hash);
+
+#endif
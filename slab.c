@@ -0,0 +1,48 @@
+#include <stdlib.h>
+
+#include "slab.h"
+
+struct SlabPage {
+    SlabPage* next;
+    usize size;
+};
+
+// Keeps the slots after the header granule-aligned.
+#define HEADER_SIZE \
+    ((sizeof(SlabPage) + SLAB_GRANULE - 1) / SLAB_GRANULE * SLAB_GRANULE)
+
+void initSlabs(Slabs* slabs) {
+    for (u32 i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slabs->classes[i] = (SlabClass){ .free = NULL, .next = NULL,
+                                         .end = NULL };
+    }
+    slabs->pages = NULL;
+    slabs->reserved = 0;
+}
+
+void freeSlabs(Slabs* slabs, const Allocator* allocator) {
+    SlabPage* page = slabs->pages;
+    while (page != NULL) {
+        SlabPage* next = page->next;
+        allocator->reallocate(allocator->context, page, page->size, 0);
+        page = next;
+    }
+    initSlabs(slabs);
+}
+
+void* refillSlab(Slabs* slabs, const Allocator* allocator,
+                 SlabClass* sizeClass, usize slotSize) {
+    SlabPage* page = allocator->reallocate(allocator->context, NULL, 0,
+                                           SLAB_PAGE_SIZE);
+    if (page == NULL) exit(SYSERR);
+    page->size = SLAB_PAGE_SIZE;
+    page->next = slabs->pages;
+    slabs->pages = page;
+    slabs->reserved += SLAB_PAGE_SIZE;
+
+    // Whatever is left of the previous page is too small for a slot.
+    u8* slots = (u8*)page + HEADER_SIZE;
+    sizeClass->next = slots + slotSize;
+    sizeClass->end = (u8*)page + SLAB_PAGE_SIZE;
+    return slots;
+}
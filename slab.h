@@ -0,0 +1,72 @@
+#ifndef clox_slab_h
+#define clox_slab_h
+
+#include "common.h"
+#include "memory.h"
+
+#define SLAB_GRANULE   8
+#define SLAB_MAX_SIZE  128
+#define SLAB_CLASS_COUNT (SLAB_MAX_SIZE / SLAB_GRANULE)
+#define SLAB_PAGE_SIZE (16 * 1024)
+
+typedef struct SlabPage SlabPage;
+
+typedef struct SlabSlot {
+    struct SlabSlot* next;
+} SlabSlot;
+
+// One size class. Freed slots are reused first; after that slots are cut
+// from the unused end of the class's newest page.
+typedef struct {
+    SlabSlot* free;
+    u8* next;
+    u8* end;
+} SlabClass;
+
+// Pages of equal-sized slots for heap objects and short string payloads,
+// so those are packed densely instead of being one malloc apiece. Every
+// page goes back to the allocator at once when the VM is freed.
+typedef struct {
+    SlabClass classes[SLAB_CLASS_COUNT];
+    SlabPage* pages;
+    usize reserved;  // bytes obtained from the allocator
+} Slabs;
+
+void initSlabs(Slabs* slabs);
+void freeSlabs(Slabs* slabs, const Allocator* allocator);
+// Starts a new page for a class whose free list and page are both empty.
+void* refillSlab(Slabs* slabs, const Allocator* allocator,
+                 SlabClass* sizeClass, usize slotSize);
+
+static inline u32 slabClassOf(usize size) {
+    return (u32)((size - 1) / SLAB_GRANULE);
+}
+
+// 0 < size <= SLAB_MAX_SIZE.
+static inline void* slabAllocate(Slabs* slabs, const Allocator* allocator,
+                                 usize size) {
+    u32 index = slabClassOf(size);
+    SlabClass* sizeClass = &slabs->classes[index];
+    if (sizeClass->free != NULL) {
+        SlabSlot* slot = sizeClass->free;
+        sizeClass->free = slot->next;
+        return slot;
+    }
+    usize slotSize = (usize)(index + 1) * SLAB_GRANULE;
+    if ((usize)(sizeClass->end - sizeClass->next) >= slotSize) {
+        void* slot = sizeClass->next;
+        sizeClass->next += slotSize;
+        return slot;
+    }
+    return refillSlab(slabs, allocator, sizeClass, slotSize);
+}
+
+// `size` must be the size the slot was allocated with.
+static inline void slabFree(Slabs* slabs, void* pointer, usize size) {
+    SlabClass* sizeClass = &slabs->classes[slabClassOf(size)];
+    SlabSlot* slot = pointer;
+    slot->next = sizeClass->free;
+    sizeClass->free = slot;
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef clox_tokenizer_h
 #define clox_tokenizer_h
 
+#include "common.h"
+
 typedef enum {
     // Single character tokens
 	TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
@@ -65,7 +67,13 @@ typedef struct {
     int line;
 } Token;
 
-void initTokenizer(const char* source);
-Token scanToken(void);
+typedef struct {
+    const char* start;  // the ptr is not constant, just the str it pts to
+    const char* current;
+    u32 line;
+} Tokenizer;
+
+void initTokenizer(Tokenizer* tokenizer, const char* source);
+Token scanToken(Tokenizer* tokenizer);
 
 #endif
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -6,13 +7,50 @@
 #include "value.h"
 
 bool valuesEqual(Value a, Value b) {
-    if (a.type != b.type) return false;
+    if (a.type != b.type) {
+        return isNumber(a) && isNumber(b) && numberCompare(a, b) == 0;
+    }
     switch (a.type) {
         case VAL_BOOL:  return a.as.boolean == b.as.boolean;
         case VAL_NIL:   return true;
         case VAL_NUMBER:return a.as.number == b.as.number;
-        case VAL_OBJ:   return a.as.obj == b.as.obj;
+        case VAL_OBJ:
+            if (a.as.obj == b.as.obj) return true;
+            return isObjType(a, OBJ_STRING) && isObjType(b, OBJ_STRING) &&
+                   stringsEqual(stringFrom(a), stringFrom(b));
+        case VAL_INT:   return a.as.integer == b.as.integer;
+    }
+}
+
+// Compares an integer with a double without rounding the integer.
+static i32 compareIntWithDouble(i64 i, f64 d) {
+    if (d != d) return NUMBERS_UNORDERED;
+    if (d >= 9223372036854775808.0) return -1;   // 2^63
+    if (d < -9223372036854775808.0) return 1;
+    // d now truncates to an i64 exactly; the fraction breaks ties.
+    i64 whole = (i64)d;
+    if (i != whole) return i < whole ? -1 : 1;
+    f64 fraction = d - (f64)whole;
+    return fraction > 0 ? -1 : fraction < 0 ? 1 : 0;
+}
+
+i32 numberCompare(Value a, Value b) {
+    if (a.type == VAL_INT) {
+        if (b.type == VAL_INT) {
+            i64 x = a.as.integer;
+            i64 y = b.as.integer;
+            return (x > y) - (x < y);
+        }
+        return compareIntWithDouble(a.as.integer, b.as.number);
     }
+    if (b.type == VAL_INT) {
+        i32 order = compareIntWithDouble(b.as.integer, a.as.number);
+        return order == NUMBERS_UNORDERED ? order : -order;
+    }
+    if (a.as.number < b.as.number) return -1;
+    if (a.as.number > b.as.number) return 1;
+    if (a.as.number == b.as.number) return 0;
+    return NUMBERS_UNORDERED;
 }
 
 void initValueArray(ValueArray* array) {
@@ -21,12 +59,12 @@ void initValueArray(ValueArray* array) {
     array->count = 0;
 }
 
-void appendValueArray(ValueArray* array, Value value) {
+void appendValueArray(VM* vm, ValueArray* array, Value value) {
     if (array->capacity <= array->count) {
         int oldCapacity = array->capacity;
         array->capacity = GROW_CAPACITY(oldCapacity);
-        array->values = GROW_ARRAY(
-            Value, array->values, oldCapacity, array->capacity
+        array->values = GROW_ARRAY(vm,
+            Value, array->values, oldCapacity, array->capacity, MEM_CONSTANTS
         );
     }
 
@@ -34,18 +72,163 @@ void appendValueArray(ValueArray* array, Value value) {
     array->count++;
 }
 
-void freeValueArray(ValueArray* array) {
-    FREE_ARRAY(Value, array->values, array->capacity);
+void freeValueArray(VM* vm, ValueArray* array) {
+    FREE_ARRAY(vm, Value, array->values, array->capacity, MEM_CONSTANTS);
     initValueArray(array);
 }
 
-void printValue(Value value) {
+static const f64 powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Writes the decimal digits of n backwards from `end`. Returns the first
+// digit.
+static char* writeDigitsBackward(char* end, u64 n) {
+    do {
+        *--end = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    return end;
+}
+
+// Scales `magnitude` to the six significant digits %g prints, returning
+// false when the rounding is too close to call in double arithmetic. Only
+// used where every power of ten involved is exact, so the one multiply or
+// divide is off by at most half an ulp.
+static bool roundToSixDigits(f64 magnitude, u32* digits, i32* exponent) {
+    i32 e = 0;
+    while (e < 14 && magnitude >= powersOf10[e + 1]) e++;
+    while (e <= 0 && e > -5 && magnitude * powersOf10[-e] < 1.0) e--;
+
+    // The estimate can be one off right at a power of ten.
+    for (u32 attempt = 0; attempt < 3; attempt++) {
+        i32 shift = 5 - e;
+        f64 scaled = shift >= 0 ? magnitude * powersOf10[shift]
+                                : magnitude / powersOf10[-shift];
+        if (scaled < 100000.0) {
+            e--;
+        } else if (scaled >= 1000000.0) {
+            e++;
+        } else {
+            f64 whole = floor(scaled);
+            if (fabs(scaled - whole - 0.5) < 1e-6) return false;
+            u32 n = (u32)whole + (scaled - whole > 0.5);
+            if (n == 1000000) {
+                n = 100000;
+                e++;
+            }
+            *digits = n;
+            *exponent = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+// printf's "%g": six significant digits, trailing zeros dropped, and
+// exponent notation outside 1e-4 <= |n| < 1e6. Integers and the common
+// range of magnitudes are formatted by hand; anything the fast path cannot
+// round exactly goes to snprintf, so the output is always identical.
+u32 formatNumber(f64 number, char* buffer) {
+    f64 magnitude = fabs(number);
+    char* out = buffer;
+
+    if (magnitude < 1e6 && number == (f64)(i64)number) {
+        if (signbit(number)) *out++ = '-';
+        char digits[8];
+        char* first = writeDigitsBackward(digits + sizeof(digits),
+                                          (u64)magnitude);
+        u32 length = (u32)(digits + sizeof(digits) - first);
+        memcpy(out, first, length);
+        return (u32)(out - buffer) + length;
+    }
+
+    u32 digits;
+    i32 exponent;
+    if (!(magnitude >= 1e-5 && magnitude < 1e15) ||
+        !roundToSixDigits(magnitude, &digits, &exponent)) {
+        return (u32)snprintf(buffer, NUMBER_BUFFER_SIZE, "%g", number);
+    }
+
+    if (number < 0) *out++ = '-';
+    char text[6];
+    writeDigitsBackward(text + 6, digits);
+    u32 significant = 6;
+    while (text[significant - 1] == '0') significant--;
+
+    if (exponent < -4 || exponent >= 6) {
+        *out++ = text[0];
+        if (significant > 1) {
+            *out++ = '.';
+            memcpy(out, text + 1, significant - 1);
+            out += significant - 1;
+        }
+        *out++ = 'e';
+        *out++ = exponent < 0 ? '-' : '+';
+        i32 power = exponent < 0 ? -exponent : exponent;
+        *out++ = (char)('0' + power / 10);
+        *out++ = (char)('0' + power % 10);
+    } else if (exponent < 0) {
+        *out++ = '0';
+        *out++ = '.';
+        for (i32 i = -1; i > exponent; i--) *out++ = '0';
+        memcpy(out, text, significant);
+        out += significant;
+    } else {
+        u32 whole = (u32)exponent + 1;
+        memcpy(out, text, whole);
+        out += whole;
+        if (significant > whole) {
+            *out++ = '.';
+            memcpy(out, text + whole, significant - whole);
+            out += significant - whole;
+        }
+    }
+    return (u32)(out - buffer);
+}
+
+u32 formatInteger(i64 integer, char* buffer) {
+    char digits[20];
+    // Negating in u64 keeps I64_MIN in range.
+    u64 magnitude = integer < 0 ? 0 - (u64)integer : (u64)integer;
+    char* first = writeDigitsBackward(digits + sizeof(digits), magnitude);
+    u32 length = (u32)(digits + sizeof(digits) - first);
+    char* out = buffer;
+    if (integer < 0) *out++ = '-';
+    memcpy(out, first, length);
+    return (u32)(out - buffer) + length;
+}
+
+void writeValue(OutputBuffer* output, Value value) {
     switch (value.type) {
         case VAL_BOOL:
-            printf(value.as.boolean ? "true" : "false");
+            if (value.as.boolean) {
+                writeBytes(output, "true", 4);
+            } else {
+                writeBytes(output, "false", 5);
+            }
+            break;
+        case VAL_NIL: writeBytes(output, "nil", 3); break;
+        case VAL_NUMBER: {
+            char buffer[NUMBER_BUFFER_SIZE];
+            writeBytes(output, buffer, formatNumber(value.as.number, buffer));
             break;
-        case VAL_NIL: printf("nil"); break;
-        case VAL_NUMBER: printf("%g", value.as.number); break;
-        case VAL_OBJ: printObject(value); break;
+        }
+        case VAL_OBJ: writeObject(output, value); break;
+        case VAL_INT: {
+            char buffer[NUMBER_BUFFER_SIZE];
+            writeBytes(output, buffer,
+                       formatInteger(value.as.integer, buffer));
+            break;
+        }
     }
 }
+
+// Unbuffered, for the disassembler and the execution trace.
+void printValue(FILE* out, Value value) {
+    OutputBuffer output;
+    initOutput(&output, out);
+    writeValue(&output, value);
+    flushOutput(&output);
+}
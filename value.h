@@ -1,7 +1,10 @@
 #ifndef clox_value_h
 #define clox_value_h
 
+#include <stdio.h>
+
 #include "common.h"
+#include "output.h"
 
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
@@ -11,6 +14,7 @@ typedef enum {
     VAL_NIL,
     VAL_NUMBER,
     VAL_OBJ,
+    VAL_INT,  // exact integers; arithmetic falls back to VAL_NUMBER
 } ValueType;
 
 typedef struct {
@@ -18,6 +22,7 @@ typedef struct {
     union {
         bool boolean;
         f64 number;
+        i64 integer;
         Obj* obj;
     } as;
 } Value;
@@ -26,6 +31,7 @@ typedef struct {
 #define NIL_VAL             ((Value){VAL_NIL, {.number = 0}})
 #define NUMBER_VAL(value)   ((Value){VAL_NUMBER, {.number = value}})
 #define OBJ_VAL(object)     ((Value){VAL_OBJ, {.obj = (Obj*)object}})
+#define INT_VAL(value)      ((Value){VAL_INT, {.integer = value}})
 
 typedef struct {
     u32 capacity;
@@ -33,10 +39,93 @@ typedef struct {
     Value* values;
 } ValueArray;
 
+// Enough for any number formatNumber() writes.
+#define NUMBER_BUFFER_SIZE 32
+
 bool valuesEqual(Value a, Value b);
-void printValue(Value value);
+
+// Numbers come in two kinds. Integer literals and integer arithmetic that
+// does not overflow stay VAL_INT. Overflow, division and any operation
+// with a VAL_NUMBER operand give a VAL_NUMBER.
+static inline bool isNumber(Value value) {
+    return value.type == VAL_NUMBER || value.type == VAL_INT;
+}
+
+static inline f64 asNumber(Value value) {
+    return value.type == VAL_INT ? (f64)value.as.integer : value.as.number;
+}
+
+// The operands must satisfy isNumber().
+static inline Value numberAdd(Value a, Value b) {
+    i64 result;
+    if (a.type == VAL_INT && b.type == VAL_INT &&
+        !__builtin_add_overflow(a.as.integer, b.as.integer, &result)) {
+        return INT_VAL(result);
+    }
+    return NUMBER_VAL(asNumber(a) + asNumber(b));
+}
+
+static inline Value numberSubtract(Value a, Value b) {
+    i64 result;
+    if (a.type == VAL_INT && b.type == VAL_INT &&
+        !__builtin_sub_overflow(a.as.integer, b.as.integer, &result)) {
+        return INT_VAL(result);
+    }
+    return NUMBER_VAL(asNumber(a) - asNumber(b));
+}
+
+static inline Value numberMultiply(Value a, Value b) {
+    i64 result;
+    if (a.type == VAL_INT && b.type == VAL_INT &&
+        !__builtin_mul_overflow(a.as.integer, b.as.integer, &result)) {
+        return INT_VAL(result);
+    }
+    return NUMBER_VAL(asNumber(a) * asNumber(b));
+}
+
+static inline Value numberDivide(Value a, Value b) {
+    return NUMBER_VAL(asNumber(a) / asNumber(b));
+}
+
+static inline Value numberNegate(Value a) {
+    if (a.type == VAL_INT && a.as.integer != I64_MIN) {
+        return INT_VAL(-a.as.integer);
+    }
+    return NUMBER_VAL(-asNumber(a));
+}
+
+#define NUMBERS_UNORDERED 2
+
+// Compares two numbers of either kind exactly, even past 2^53 where an
+// integer has no exact double. Returns -1, 0 or 1, or NUMBERS_UNORDERED
+// when either is NaN.
+i32 numberCompare(Value a, Value b);
+
+// numberLess(a, b) and friends: `a op b` for numbers of either kind, with
+// the same-kind cases inline.
+#define NUMBER_COMPARISON(name, op) \
+    static inline bool name(Value a, Value b) { \
+        if (a.type == VAL_INT && b.type == VAL_INT) { \
+            return a.as.integer op b.as.integer; \
+        } \
+        if (a.type == VAL_NUMBER && b.type == VAL_NUMBER) { \
+            return a.as.number op b.as.number; \
+        } \
+        i32 order = numberCompare(a, b); \
+        return order != NUMBERS_UNORDERED && order op 0; \
+    }
+NUMBER_COMPARISON(numberLess, <)
+NUMBER_COMPARISON(numberGreater, >)
+#undef NUMBER_COMPARISON
+
+// Formats a number exactly as printf("%g") would, without the format
+// string parsing. Returns the length; the result is not NUL-terminated.
+u32 formatNumber(f64 number, char* buffer);
+u32 formatInteger(i64 integer, char* buffer);
+void writeValue(OutputBuffer* output, Value value);
+void printValue(FILE* out, Value value);
 void initValueArray(ValueArray* array);
-void appendValueArray(ValueArray* array, Value value);
-void freeValueArray(ValueArray* array);
+void appendValueArray(VM* vm, ValueArray* array, Value value);
+void freeValueArray(VM* vm, ValueArray* array);
 
 #endif
@@ -1,200 +1,797 @@
+#include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "chunk.h"
 #include "hash_table.h"
+#include "jit.h"
+#include "list_kernels.h"
 #include "memory.h"
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "natives.h"
 #include "object.h"
+#include "perf_stats.h"
+#include "profiler.h"
+#include "sampler.h"
 #include "value.h"
 #include "vm.h"
 
-VM vm;
-
-static void resetStack() {
-    vm.stackTop = vm.stack;
+static void resetStack(VM* vm) {
+    vm->stackTop = vm->stack;
+    vm->frameCount = 0;
 }
 
-static void runtimeError(const char* format, ...) {
+void runtimeError(VM* vm, const char* format, ...) {
+    // Output printed before the error has to show up before it.
+    flushOutput(&vm->output);
+
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(vm->err, format, args);
     va_end(args);
-    fputs("\n", stderr);
+    fputs("\n", vm->err);
+
+    for (i32 i = (i32)vm->frameCount - 1; i >= 0; i--) {
+        CallFrame* frame = &vm->frames[i];
+        ObjFunction* function = frame->function;
+        usize instrIndex = frame->ip - function->chunk.code - 1;
+        if (vm->registerBackend) {
+            RegisterCode* registers = function->registers;
+            instrIndex = registers->origins[frame->pc - registers->code - 1];
+        }
+        u32 line = getLine(&function->chunk.runTable, instrIndex);
+        fprintf(vm->err, "[line %d] in ", line);
+        if (function->name == NULL) {
+            fprintf(vm->err, "script\n");
+        } else {
+            fprintf(vm->err, "%s()\n", function->name->chars);
+        }
+    }
+    resetStack(vm);
+}
+
+VM* newVM() {
+    return newVMWithAllocator(systemAllocator);
+}
+
+VM* newVMWithAllocator(Allocator allocator) {
+    // The VM owns the allocation counters, so it cannot go through
+    // reallocate() itself.
+    VM* vm = allocator.reallocate(allocator.context, NULL, 0, sizeof(VM));
+    if (vm == NULL) exit(SYSERR);
+    vm->allocator = allocator;
+    initArena(&vm->arena);
+    initSlabs(&vm->slabs);
+
+    resetStack(vm);
+    vm->instructionCount = 0;
+    vm->objects = NULL;
+    vm->sharedStrings = false;
+    vm->registerBackend = false;
+    vm->jitEnabled = false;
+    vm->out = stdout;
+    vm->err = stderr;
+    initOutput(&vm->output, stdout);
+    memset(&vm->memStats, 0, sizeof(vm->memStats));
+    initHashTable(&vm->globals);
+    initHashTable(&vm->strings);
+    defineStandardNatives(vm);
+    return vm;
+}
+
+void freeVM(VM* vm) {
+    flushOutput(&vm->output);
+    freeHashTable(vm, &vm->globals);
+    freeHashTable(vm, &vm->strings);
+    freeObjects(vm);
+    freeSlabs(&vm->slabs, &vm->allocator);
+    freeArena(&vm->arena, &vm->allocator);
+    Allocator allocator = vm->allocator;
+    allocator.reallocate(allocator.context, vm, sizeof(VM), 0);
+}
+
+void defineNative(VM* vm, const char* name, NativeFn function, i32 arity) {
+    ObjString* nameString = copyString(vm, name, (u32)strlen(name));
+    ObjNative* native = newNative(vm, function, arity, nameString);
+    hashTableSet(vm, &vm->globals, nameString, OBJ_VAL(native));
+}
+
+void push(VM* vm, Value value) {
+    *vm->stackTop++ = value;
+}
 
-    usize instrIndex = vm.ip - vm.chunk->code - 1;
-    u32 line = getLine(&vm.chunk->runTable, instrIndex);
-    fprintf(stderr, "[line %d] in script\n", line);
-    resetStack();
+Value pop(VM* vm) {
+    return *--vm->stackTop;
 }
 
-void initVM() {
-    resetStack();
-    vm.objects = NULL;
-    initHashTable(&vm.globals);
-    initHashTable(&vm.strings);
+Value peek(VM* vm, i32 distance) {
+    return vm->stackTop[-1 - distance];
 }
 
-void freeVM() {
-    freeHashTable(&vm.globals);
-    freeHashTable(&vm.strings);
-    freeObjects();
+void replaceTop(VM* vm, Value value) {
+    vm->stackTop[-1] = value;
 }
 
-void push(Value value) {
-    *vm.stackTop++ = value;
+Value top(VM* vm) {
+    return vm->stackTop[-1];
 }
 
-Value pop() {
-    return *--vm.stackTop;
+Value* top_mut(VM* vm) {
+    return &vm->stackTop[-1];
+}
+
+static inline void concatenate(VM* vm) {
+    ObjString* b = stringFrom(pop(vm));
+    ObjString* a = stringFrom(pop(vm));
+    push(vm, OBJ_VAL(concatStrings(vm, a, b)));
+}
+
+static bool checkArity(VM* vm, ObjFunction* function, u32 argCount) {
+    if (argCount != function->arity) {
+        runtimeError(vm, "Expected %d arguments but got %d.",
+                     function->arity, argCount);
+        return false;
+    }
+    return true;
+}
+
+static bool call(VM* vm, ObjFunction* function, u32 argCount) {
+    if (!checkArity(vm, function, argCount)) return false;
+
+    if (vm->frameCount == FRAMES_MAX) {
+        runtimeError(vm, "Stack overflow.");
+        return false;
+    }
+
+    CallFrame* frame = &vm->frames[vm->frameCount++];
+    frame->function = function;
+    frame->ip = function->chunk.code;
+    if (vm->registerBackend) frame->pc = function->registers->code;
+    frame->slots = vm->stackTop - argCount - 1;
+    return true;
+}
+
+// Natives run without a CallFrame: they see their arguments in place on the
+// stack, and the callee and arguments are replaced by the result.
+static bool callNative(VM* vm, ObjNative* native, u32 argCount) {
+    if (native->arity != NATIVE_VARIADIC && argCount != (u32)native->arity) {
+        runtimeError(vm, "Expected %d arguments but got %d.",
+                     native->arity, argCount);
+        return false;
+    }
+
+    Value result;
+    if (!native->function(vm, argCount, vm->stackTop - argCount, &result)) {
+        return false;
+    }
+    vm->stackTop -= argCount;
+    replaceTop(vm, result);
+    return true;
+}
+
+static bool callValue(VM* vm, Value callee, u32 argCount) {
+    if (isObjType(callee, OBJ_FUNCTION)) {
+        return call(vm, functionFrom(callee), argCount);
+    }
+    if (isObjType(callee, OBJ_NATIVE)) {
+        return callNative(vm, nativeFrom(callee), argCount);
+    }
+
+    runtimeError(vm, "Can only call functions.");
+    return false;
 }
 
-Value peek(i32 distance) {
-    return vm.stackTop[-1 - distance];
+// Reuses the caller's frame: the callee and its arguments slide down over
+// the caller's stack window, so tail-recursive loops run in constant space.
+static bool tailCall(VM* vm, Value callee, u32 argCount) {
+    // A native never had a frame to reuse.
+    if (isObjType(callee, OBJ_NATIVE)) {
+        return callNative(vm, nativeFrom(callee), argCount);
+    }
+    if (!isObjType(callee, OBJ_FUNCTION)) {
+        runtimeError(vm, "Can only call functions.");
+        return false;
+    }
+
+    ObjFunction* function = functionFrom(callee);
+    if (!checkArity(vm, function, argCount)) return false;
+
+    CallFrame* frame = &vm->frames[vm->frameCount - 1];
+    Value* callSlots = vm->stackTop - argCount - 1;
+    memmove(frame->slots, callSlots, sizeof(Value) * (argCount + 1));
+    vm->stackTop = frame->slots + argCount + 1;
+    frame->function = function;
+    frame->ip = function->chunk.code;
+    if (vm->registerBackend) frame->pc = function->registers->code;
+    return true;
 }
 
-void replaceTop(Value value) {
-    vm.stackTop[-1] = value;
+// Checks that `index` is an integer inside the list's bounds.
+bool checkListIndex(VM* vm, ObjList* list, Value index, u32* slot) {
+    if (index.type == VAL_INT) {
+        i64 integer = index.as.integer;
+        if (integer < 0 || integer >= list->items.count) {
+            runtimeError(vm, "List index %" I64_FMT " out of bounds for "
+                         "length %u.", integer, list->items.count);
+            return false;
+        }
+        *slot = (u32)integer;
+        return true;
+    }
+    if (index.type != VAL_NUMBER) {
+        runtimeError(vm, "List index must be a number.");
+        return false;
+    }
+
+    f64 number = index.as.number;
+    if (number != floor(number)) {
+        runtimeError(vm, "List index must be an integer.");
+        return false;
+    }
+    if (!(number >= 0 && number < list->items.count)) {
+        runtimeError(vm, "List index %g out of bounds for length %u.",
+                     number, list->items.count);
+        return false;
+    }
+
+    *slot = (u32)number;
+    return true;
 }
 
-Value top() {
-    return vm.stackTop[-1];
+static bool checkNumbers(VM* vm, ListKernel kernel, const ValueArray* items,
+                         bool* sawInteger) {
+    u32 bad = firstNonNumber(items->values, items->count, sawInteger);
+    if (bad == items->count) return true;
+
+    runtimeError(vm, "'%s' needs a list of numbers, but item %u is not one.",
+                 listKernelName(kernel), bad);
+    return false;
 }
 
-Value* top_mut() {
-    return &vm.stackTop[-1];
+// The second list operand of 'dot' and 'add'.
+static ValueArray* kernelOperand(VM* vm, ListKernel kernel, u32 count,
+                                 bool* sawInteger) {
+    const char* name = listKernelName(kernel);
+    if (!isObjType(top(vm), OBJ_LIST)) {
+        runtimeError(vm, "Argument to '%s' must be a list.", name);
+        return NULL;
+    }
+
+    ValueArray* other = &listFrom(top(vm))->items;
+    if (other->count != count) {
+        runtimeError(vm, "'%s' needs lists of the same length, got %u and %u.",
+                     name, count, other->count);
+        return NULL;
+    }
+    if (!checkNumbers(vm, kernel, other, sawInteger)) return NULL;
+    return other;
 }
 
-static inline void concatenate() {
-    ObjString* b = stringFrom(pop());
-    ObjString* a = stringFrom(pop());
+// Replaces the receiver list (and argument, if any) with the kernel result.
+// Every item is type-checked once up front, so the kernels themselves run
+// straight over the number payloads. Lists of doubles take the unrolled
+// kernels; any integer operand switches to the exact ones.
+bool runListKernel(VM* vm, ListKernel kernel) {
+    const char* name = listKernelName(kernel);
+    u32 arity = listKernelArity(kernel);
+    if (!isObjType(peek(vm, arity), OBJ_LIST)) {
+        runtimeError(vm, "Only lists have '%s'.", name);
+        return false;
+    }
+
+    ValueArray* items = &listFrom(peek(vm, arity))->items;
+    bool integers = false;
+    if (!checkNumbers(vm, kernel, items, &integers)) return false;
 
-    u32 length = a->length + b->length;
-    char* chars = ALLOCATE(char, length+1);
-    memcpy(chars, a->chars, a->length);
-    memcpy(chars + a->length, b->chars, b->length);
-    chars[length] = '\0';
+    Value result = NIL_VAL;
+    switch (kernel) {
+        case KERNEL_SUM:
+            result = integers
+                ? sumValues(items->values, items->count)
+                : NUMBER_VAL(sumNumbers(items->values, items->count));
+            break;
+        case KERNEL_MIN:
+        case KERNEL_MAX: {
+            if (items->count == 0) {
+                runtimeError(vm, "Can't take the %s of an empty list.", name);
+                return false;
+            }
+            if (integers) {
+                result = kernel == KERNEL_MIN
+                    ? minValue(items->values, items->count)
+                    : maxValue(items->values, items->count);
+            } else {
+                result = NUMBER_VAL(kernel == KERNEL_MIN
+                    ? minNumbers(items->values, items->count)
+                    : maxNumbers(items->values, items->count));
+            }
+            break;
+        }
+        case KERNEL_DOT: {
+            ValueArray* other = kernelOperand(vm, kernel, items->count,
+                                              &integers);
+            if (other == NULL) return false;
+            result = integers
+                ? dotValues(items->values, other->values, items->count)
+                : NUMBER_VAL(dotNumbers(items->values, other->values,
+                                        items->count));
+            break;
+        }
+        case KERNEL_ADD: {
+            ValueArray* other = kernelOperand(vm, kernel, items->count,
+                                              &integers);
+            if (other == NULL) return false;
+            ObjList* sum = newList(vm, items->count);
+            if (integers) {
+                addValues(sum->items.values, items->values, other->values,
+                          items->count);
+            } else {
+                addNumbers(sum->items.values, items->values, other->values,
+                           items->count);
+            }
+            sum->items.count = items->count;
+            result = OBJ_VAL(sum);
+            break;
+        }
+        case KERNEL_SCALE: {
+            Value factor = top(vm);
+            if (!isNumber(factor)) {
+                runtimeError(vm, "Argument to 'scale' must be a number.");
+                return false;
+            }
+            ObjList* scaled = newList(vm, items->count);
+            if (integers) {
+                scaleValues(scaled->items.values, items->values, factor,
+                            items->count);
+            } else {
+                scaleNumbers(scaled->items.values, items->values,
+                             asNumber(factor), items->count);
+            }
+            scaled->items.count = items->count;
+            result = OBJ_VAL(scaled);
+            break;
+        }
+        default:
+            runtimeError(vm, "Unknown list kernel %d.", kernel);
+            return false;
+    }
 
-    ObjString* result = takeString(chars, length);
-    push(OBJ_VAL(result));
+    vm->stackTop -= arity;
+    replaceTop(vm, result);
+    return true;
 }
 
-static InterpretResult run() {
-#define READ_BYTE() (*vm.ip++)
-#define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
+static InterpretResult runFrame(VM* vm);
+
+// Interprets until the frame at depth `exitDepth` returns to its caller, or
+// the script finishes when exitDepth is 0.
+static InterpretResult run(VM* vm, u32 exitDepth) {
+    CallFrame* frame = &vm->frames[vm->frameCount - 1];
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_CONSTANT() \
+    (frame->function->chunk.constants.values[READ_BYTE()])
 #define READ_STRING() (stringFrom(READ_CONSTANT()))
-#define BINARY_OP(valueType, op) \
+#define READ_SHORT() \
+    (frame->ip += 2, (u16)((frame->ip[-2] << 8) | frame->ip[-1]))
+#define CHECK_NUMBERS(a, b) \
     do { \
-        if (peek(0).type != VAL_NUMBER || peek(1).type != VAL_NUMBER) { \
-            runtimeError("Operands must be numbers."); \
+        if (!isNumber(a) || !isNumber(b)) { \
+            runtimeError(vm, "Operands must be numbers."); \
             return INTERPRET_RUNTIME_ERROR; \
         } \
-        double b = pop().as.number; \
-        double a = pop().as.number; \
-        push(valueType(a op b)); \
+    } while (false)
+// `operation` is one of the number* helpers in value.h.
+#define ARITHMETIC_OP(operation) \
+    do { \
+        CHECK_NUMBERS(peek(vm, 1), peek(vm, 0)); \
+        Value b = pop(vm); \
+        replaceTop(vm, operation(top(vm), b)); \
+    } while (false)
+// `test` is one of the numberLess-style comparisons in value.h.
+#define COMPARISON_OP(test) \
+    do { \
+        CHECK_NUMBERS(peek(vm, 1), peek(vm, 0)); \
+        Value b = pop(vm); \
+        replaceTop(vm, BOOL_VAL(test(top(vm), b))); \
+    } while (false)
+// Rewrites the instruction being executed. Only the opcode byte changes, so
+// operands and jump offsets stay valid.
+#define QUICKEN(op) (frame->ip[-1] = (op))
+// A failed guard puts the generic opcode back and runs it instead.
+#define DESPECIALIZE(op) \
+    do { \
+        frame->ip[-1] = (op); \
+        frame->ip--; \
+    } while (false)
+#define BOTH_NUMBERS(a, b) \
+    ((((a).type ^ VAL_NUMBER) | ((b).type ^ VAL_NUMBER)) == 0)
+// Guarded numeric fast path of a quickened opcode.
+#define NUMBER_OP(valueType, op, generic) \
+    do { \
+        Value b = peek(vm, 0); \
+        Value a = peek(vm, 1); \
+        if (!BOTH_NUMBERS(a, b)) { \
+            DESPECIALIZE(generic); \
+            continue; \
+        } \
+        vm->stackTop--; \
+        replaceTop(vm, valueType(a.as.number op b.as.number)); \
+    } while (false)
+// Updates a global in place with the number on top of the stack, leaving
+// the new value there.
+#define GLOBAL_OP(operation) \
+    do { \
+        ObjString* name = READ_STRING(); \
+        Value* slot = hashTableGetSlot(&vm->globals, name); \
+        if (slot == NULL) { \
+            runtimeError(vm, "Undefined variable '%s'.", name->chars); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        CHECK_NUMBERS(*slot, top(vm)); \
+        *slot = operation(*slot, top(vm)); \
+        replaceTop(vm, *slot); \
+    } while (false)
+#define STEP_VARIABLE(slot, delta) \
+    do { \
+        Value* variable = (slot); \
+        if (variable->type == VAL_INT) { \
+            *variable = numberAdd(*variable, INT_VAL(delta)); \
+        } else if (variable->type == VAL_NUMBER) { \
+            variable->as.number += (delta); \
+        } else { \
+            runtimeError(vm, "operand must be a number."); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        push(vm, *variable); \
+    } while (false)
+// Pops both operands and jumps when `test(a, b)` comes out `jumpWhen`.
+// `>=` and `<=` are the negations of `<` and `>`, so NaN makes them true.
+#define COMPARE_JUMP(test, jumpWhen) \
+    do { \
+        u16 offset = READ_SHORT(); \
+        CHECK_NUMBERS(peek(vm, 1), peek(vm, 0)); \
+        Value b = pop(vm); \
+        Value a = pop(vm); \
+        if (test(a, b) == (jumpWhen)) frame->ip += offset; \
     } while (false)
 
     for ever {
 #ifdef DEBUG_TRACE_EXECUTION
-    printf("          ");
-    for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-        printf("[ ");
-        printValue(*slot);
-        printf(" ]");
-    }
-    printf("\n");
-    disassembleInstruction(vm.chunk, (u32)(vm.ip - vm.chunk->code));
+    flushOutput(&vm->output);
+    fprintf(vm->out, "          ");
+    for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+        fprintf(vm->out, "[ ");
+        printValue(vm->out, *slot);
+        fprintf(vm->out, " ]");
+    }
+    fprintf(vm->out, "\n");
+    disassembleInstruction(vm->out, &frame->function->chunk,
+                           (u32)(frame->ip - frame->function->chunk.code));
+#endif
+#ifdef PROFILE_OPCODES
+        vm->instructionCount++;
+        if (profilerEnabled) profileInstruction(*frame->ip);
 #endif
         u8 instruction;
         switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT: {
-                Value constant = READ_CONSTANT();
-                push(constant);
-                printValue(constant);
-                printf("\n");
+            case OP_CONSTANT: push(vm, READ_CONSTANT()); break;
+            case OP_NIL:    push(vm, NIL_VAL); break;
+            case OP_TRUE:   push(vm, BOOL_VAL(true)); break;
+            case OP_FALSE:  push(vm, BOOL_VAL(false)); break;
+            case OP_POP:    pop(vm); break;
+            case OP_POPN:   vm->stackTop -= READ_BYTE(); break;
+            case OP_GET_LOCAL: {
+                u8 slot = READ_BYTE();
+                push(vm, frame->slots[slot]);
+                break;
+            }
+            case OP_SET_LOCAL: {
+                u8 slot = READ_BYTE();
+                frame->slots[slot] = top(vm);
                 break;
             }
-            case OP_NIL:    push(NIL_VAL); break;
-            case OP_TRUE:   push(BOOL_VAL(true)); break;
-            case OP_FALSE:  push(BOOL_VAL(false)); break;
-            case OP_POP:    pop(); break;
             case OP_GET_GLOBAL: {
                 ObjString* name = READ_STRING();
-                GetResult result = hashTableGet(&vm.globals, name);
+                GetResult result = hashTableGet(&vm->globals, name);
                 if (!result.found) {
-                    runtimeError("Undefined variable '%s'.", name->chars);
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(result.value);
+                push(vm, result.value);
                 break;
             }
             case OP_DEFINE_GLOBAL: {
                 ObjString* name = READ_STRING();
-                hashTableSet(&vm.globals, name, pop());
+                hashTableSet(vm, &vm->globals, name, pop(vm));
                 break;
             }
             case OP_SET_GLOBAL: {
                 ObjString* name = READ_STRING();
-                if (hashTableSet(&vm.globals, name, top())) {
-                    hashTableDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'.", name->chars);
+                if (hashTableSet(vm, &vm->globals, name, top(vm))) {
+                    hashTableDelete(&vm->globals, name);
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
+            case OP_JUMP: {
+                u16 offset = READ_SHORT();
+                frame->ip += offset;
+                break;
+            }
+            case OP_JUMP_IF_FALSE: {
+                u16 offset = READ_SHORT();
+                if (top(vm).type != VAL_BOOL) {
+                    runtimeError(vm, "Condition must be a boolean.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (!top(vm).as.boolean) frame->ip += offset;
+                break;
+            }
+            case OP_LOOP: {
+                u16 offset = READ_SHORT();
+                frame->ip -= offset;
+                break;
+            }
+            case OP_JUMP_IF_NOT_LESS:
+                COMPARE_JUMP(numberLess, false);
+                break;
+            case OP_JUMP_IF_NOT_GREATER:
+                COMPARE_JUMP(numberGreater, false);
+                break;
+            case OP_JUMP_IF_LESS:
+                COMPARE_JUMP(numberLess, true);
+                break;
+            case OP_JUMP_IF_GREATER:
+                COMPARE_JUMP(numberGreater, true);
+                break;
+            case OP_JUMP_IF_NOT_EQUAL:
+            case OP_JUMP_IF_EQUAL: {
+                u16 offset = READ_SHORT();
+                Value rhs = pop(vm);
+                Value lhs = pop(vm);
+                bool equal = valuesEqual(lhs, rhs);
+                if (equal != (instruction == OP_JUMP_IF_NOT_EQUAL)) {
+                    frame->ip += offset;
+                }
+                break;
+            }
+            case OP_ADD_GLOBAL: {
+                if (!isObjType(top(vm), OBJ_STRING)) {
+                    GLOBAL_OP(numberAdd);
+                    break;
+                }
+
+                ObjString* name = READ_STRING();
+                GetResult current = hashTableGet(&vm->globals, name);
+                if (!current.found) {
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (!isObjType(current.value, OBJ_STRING)) {
+                    runtimeError(vm,
+                        "Operands must be two numbers or two strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value rhs = pop(vm);
+                push(vm, current.value);
+                push(vm, rhs);
+                concatenate(vm);
+                hashTableSet(vm, &vm->globals, name, top(vm));
+                break;
+            }
+            case OP_SUBTRACT_GLOBAL: GLOBAL_OP(numberSubtract); break;
+            case OP_MULTIPLY_GLOBAL: GLOBAL_OP(numberMultiply); break;
+            case OP_DIVIDE_GLOBAL:   GLOBAL_OP(numberDivide);   break;
+            case OP_INC_GLOBAL:
+            case OP_DEC_GLOBAL: {
+                ObjString* name = READ_STRING();
+                Value* slot = hashTableGetSlot(&vm->globals, name);
+                if (slot == NULL) {
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                STEP_VARIABLE(slot, instruction == OP_INC_GLOBAL ? 1 : -1);
+                break;
+            }
+            case OP_INC_LOCAL:
+                STEP_VARIABLE(&frame->slots[READ_BYTE()], 1);
+                break;
+            case OP_DEC_LOCAL:
+                STEP_VARIABLE(&frame->slots[READ_BYTE()], -1);
+                break;
             case OP_EQUAL: {
-                Value rhs = pop();
-                Value lhs = pop();
-                push(BOOL_VAL(valuesEqual(lhs, rhs)));
+                Value rhs = pop(vm);
+                Value lhs = pop(vm);
+                if (BOTH_NUMBERS(lhs, rhs)) QUICKEN(OP_EQUAL_NUM);
+                push(vm, BOOL_VAL(valuesEqual(lhs, rhs)));
                 break;
             }
-            case OP_LESS:       BINARY_OP(BOOL_VAL, <);   break;
-            case OP_GREATER:    BINARY_OP(BOOL_VAL, >);   break;
+            case OP_LESS:
+                if (BOTH_NUMBERS(peek(vm, 0), peek(vm, 1))) {
+                    QUICKEN(OP_LESS_NUM);
+                }
+                COMPARISON_OP(numberLess);
+                break;
+            case OP_GREATER:
+                if (BOTH_NUMBERS(peek(vm, 0), peek(vm, 1))) {
+                    QUICKEN(OP_GREATER_NUM);
+                }
+                COMPARISON_OP(numberGreater);
+                break;
             case OP_ADD: {
-                if (isObjType(peek(0), OBJ_STRING) && isObjType(peek(1), OBJ_STRING)) {
-                    concatenate();
-                } else if (peek(0).type == VAL_NUMBER && peek(1).type == VAL_NUMBER) {
-                    f64 b = pop().as.number;
-                    f64 a = pop().as.number;
-                    push(NUMBER_VAL(a+b));
+                Value b = peek(vm, 0);
+                Value a = peek(vm, 1);
+                if (isObjType(b, OBJ_STRING) && isObjType(a, OBJ_STRING)) {
+                    QUICKEN(OP_ADD_STR);
+                    concatenate(vm);
+                } else if (isNumber(a) && isNumber(b)) {
+                    // Integers stay on the generic opcode, which keeps
+                    // their fast path first.
+                    if (BOTH_NUMBERS(a, b)) QUICKEN(OP_ADD_NUM);
+                    vm->stackTop--;
+                    replaceTop(vm, numberAdd(a, b));
                 } else {
-                    runtimeError("Operands must be two numbers or two strings.");
+                    runtimeError(vm,
+                        "Operands must be two numbers or two strings.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
-            case OP_SUBTRACT:   BINARY_OP(NUMBER_VAL, -);   break;
-            case OP_MULTIPLY:   BINARY_OP(NUMBER_VAL, *);   break;
-            case OP_DIVIDE:     BINARY_OP(NUMBER_VAL, /);   break;
+            case OP_EQUAL_NUM:   NUMBER_OP(BOOL_VAL, ==, OP_EQUAL);   break;
+            case OP_LESS_NUM:    NUMBER_OP(BOOL_VAL, <, OP_LESS);     break;
+            case OP_GREATER_NUM: NUMBER_OP(BOOL_VAL, >, OP_GREATER);  break;
+            case OP_ADD_NUM:     NUMBER_OP(NUMBER_VAL, +, OP_ADD);    break;
+            case OP_ADD_STR: {
+                if (!isObjType(peek(vm, 0), OBJ_STRING) ||
+                    !isObjType(peek(vm, 1), OBJ_STRING)) {
+                    DESPECIALIZE(OP_ADD);
+                    continue;
+                }
+                concatenate(vm);
+                break;
+            }
+            case OP_SUBTRACT:   ARITHMETIC_OP(numberSubtract); break;
+            case OP_MULTIPLY:   ARITHMETIC_OP(numberMultiply); break;
+            case OP_DIVIDE:     ARITHMETIC_OP(numberDivide);   break;
             case OP_NOT: {
-                if (top().type != VAL_BOOL) {
-                    runtimeError("operand must be a boolean.");
+                if (top(vm).type != VAL_BOOL) {
+                    runtimeError(vm, "operand must be a boolean.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                Value* top = top_mut();
+                Value* top = top_mut(vm);
                 top->as.boolean = !top->as.boolean;
                 break;
             }
             case OP_NEGATE: {
-                if (top().type != VAL_NUMBER) {
-                    runtimeError("operand must be a number.");
+                if (!isNumber(top(vm))) {
+                    runtimeError(vm, "operand must be a number.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                replaceTop(vm, numberNegate(top(vm)));
+                break;
+            }
+            case OP_BUILD_LIST: {
+                u8 count = READ_BYTE();
+                ObjList* list = newList(vm, count);
+                if (count > 0) {
+                    memcpy(list->items.values, vm->stackTop - count,
+                           sizeof(Value) * count);
+                }
+                list->items.count = count;
+                vm->stackTop -= count;
+                push(vm, OBJ_VAL(list));
+                break;
+            }
+            case OP_GET_INDEX: {
+                if (!isObjType(peek(vm, 1), OBJ_LIST)) {
+                    runtimeError(vm, "Only lists can be indexed.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                ObjList* list = listFrom(peek(vm, 1));
+                u32 slot;
+                if (!checkListIndex(vm, list, peek(vm, 0), &slot)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                vm->stackTop--;
+                replaceTop(vm, list->items.values[slot]);
+                break;
+            }
+            case OP_SET_INDEX: {
+                if (!isObjType(peek(vm, 2), OBJ_LIST)) {
+                    runtimeError(vm, "Only lists can be indexed.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                ObjList* list = listFrom(peek(vm, 2));
+                u32 slot;
+                if (!checkListIndex(vm, list, peek(vm, 1), &slot)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                Value* top = top_mut();
-                top->as.number = -top->as.number;
+                Value value = pop(vm);
+                list->items.values[slot] = value;
+                vm->stackTop--;
+                replaceTop(vm, value);
+                break;
+            }
+            case OP_LIST_LENGTH: {
+                if (!isObjType(top(vm), OBJ_LIST)) {
+                    runtimeError(vm, "Only lists have a length.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                replaceTop(vm, INT_VAL(listFrom(top(vm))->items.count));
+                break;
+            }
+            case OP_LIST_APPEND: {
+                if (!isObjType(peek(vm, 1), OBJ_LIST)) {
+                    runtimeError(vm, "Can only append to a list.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value value = pop(vm);
+                appendList(vm, listFrom(top(vm)), value);
+                replaceTop(vm, NIL_VAL);
+                break;
+            }
+            case OP_LIST_KERNEL: {
+                if (!runListKernel(vm, (ListKernel)READ_BYTE())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OP_CALL: {
+                u8 argCount = READ_BYTE();
+                if (!callValue(vm, peek(vm, argCount), argCount)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                frame = &vm->frames[vm->frameCount - 1];
+                // Interpreted frames never have machine code, so this is
+                // a new frame for a compiled callee.
+                if (frame->function->jit != NULL) {
+                    if (runFrame(vm) != INTERPRET_OK) {
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    frame = &vm->frames[vm->frameCount - 1];
+                }
+                break;
+            }
+            case OP_TAIL_CALL: {
+                u8 argCount = READ_BYTE();
+                if (!tailCall(vm, peek(vm, argCount), argCount)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (frame->function->jit != NULL) {
+                    // The compiled callee returns from this frame for us.
+                    if (runFrame(vm) != INTERPRET_OK) {
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    if (vm->frameCount == exitDepth) return INTERPRET_OK;
+                    frame = &vm->frames[vm->frameCount - 1];
+                }
                 break;
             }
             case OP_RETURN: {
-                // Exit interpreter.
-                return INTERPRET_OK;
+                Value result = pop(vm);
+                vm->frameCount--;
+                if (vm->frameCount == 0) {
+                    // Exit interpreter.
+                    pop(vm);
+                    return INTERPRET_OK;
+                }
+
+                vm->stackTop = frame->slots;
+                push(vm, result);
+                if (vm->frameCount == exitDepth) return INTERPRET_OK;
+                frame = &vm->frames[vm->frameCount - 1];
+                break;
             }
             case OP_PRINT: {
-                printValue(pop());
-                printf("\n");
+                writeValue(&vm->output, pop(vm));
+                writeChar(&vm->output, '\n');
                 break;
             }
         }
@@ -202,25 +799,437 @@ static InterpretResult run() {
 #undef READ_BYTE
 #undef READ_CONSTANT
 #undef READ_STRING
-#undef BINARY_OP
+#undef READ_SHORT
+#undef CHECK_NUMBERS
+#undef ARITHMETIC_OP
+#undef COMPARISON_OP
+#undef QUICKEN
+#undef DESPECIALIZE
+#undef BOTH_NUMBERS
+#undef NUMBER_OP
+#undef GLOBAL_OP
+#undef STEP_VARIABLE
+#undef COMPARE_JUMP
 }
 
-InterpretResult interpret(const char* source) {
-    InterpretResult result;
-    Chunk chunk;
-    initChunk(&chunk);
+// Runs the newest frame until it returns: as machine code when its function
+// was compiled, in the interpreter otherwise. A tail call can switch from
+// one to the other in the same frame.
+static InterpretResult runFrame(VM* vm) {
+    u32 exitDepth = vm->frameCount - 1;
+    for ever {
+        CallFrame* frame = &vm->frames[vm->frameCount - 1];
+        JitCode* jit = frame->function->jit;
+        if (jit == NULL) return run(vm, exitDepth);
 
-    if (!compile(source, &chunk)) {
-        result = INTERPRET_COMPILE_ERROR;
-        goto cleanup;
+        switch (jit->entry(vm, frame)) {
+            case JIT_ERROR:
+                return INTERPRET_RUNTIME_ERROR;
+            case JIT_RETURN:
+                vm->frameCount--;
+                if (vm->frameCount == 0) vm->stackTop = vm->stack;
+                return INTERPRET_OK;
+            case JIT_TAIL_CALL:
+                break;
+        }
     }
+}
+
+bool callFromJit(VM* vm, u32 argCount) {
+    u32 frameCount = vm->frameCount;
+    if (!callValue(vm, peek(vm, argCount), argCount)) return false;
+    // Natives have already finished.
+    return vm->frameCount == frameCount || runFrame(vm) == INTERPRET_OK;
+}
+
+JitStatus tailCallFromJit(VM* vm, u32 argCount) {
+    Value callee = peek(vm, argCount);
+    if (!tailCall(vm, callee, argCount)) return JIT_ERROR;
+    return isObjType(callee, OBJ_NATIVE) ? JIT_RETURN : JIT_TAIL_CALL;
+}
+
+// The register backend's dispatch loop. The stack top always sits just past
+// the current frame's registers, so calls, natives and list kernels, which
+// still take their operands from the stack, find the frame below them and
+// the callee's window above.
+static InterpretResult runRegisters(VM* vm) {
+    CallFrame* frame = &vm->frames[vm->frameCount - 1];
+    vm->stackTop = frame->slots + frame->function->registers->frameSize;
 
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
+#define R(index) (frame->slots[index])
+#define K(index) (frame->function->chunk.constants.values[index])
+#define RESTORE_TOP() \
+    (vm->stackTop = frame->slots + frame->function->registers->frameSize)
+#define BOTH_NUMBERS(a, b) \
+    ((((a).type ^ VAL_NUMBER) | ((b).type ^ VAL_NUMBER)) == 0)
+#define CHECK_NUMBERS(a, b) \
+    do { \
+        if (!isNumber(a) || !isNumber(b)) { \
+            runtimeError(vm, "Operands must be numbers."); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+    } while (false)
+// `operation` is one of the number* helpers in value.h.
+#define ARITH_OP(operation) \
+    do { \
+        Value b = R(REG_C(instr)); \
+        Value a = R(REG_B(instr)); \
+        CHECK_NUMBERS(a, b); \
+        R(REG_A(instr)) = operation(a, b); \
+    } while (false)
+#define COMPARE_OP(test) \
+    do { \
+        Value b = R(REG_C(instr)); \
+        Value a = R(REG_B(instr)); \
+        CHECK_NUMBERS(a, b); \
+        R(REG_A(instr)) = BOOL_VAL(test(a, b)); \
+    } while (false)
+#define STEP_VARIABLE(slot) \
+    do { \
+        Value* variable = (slot); \
+        if (variable->type == VAL_INT) { \
+            *variable = numberAdd(*variable, \
+                                  INT_VAL(REG_C(instr) ? -1 : 1)); \
+        } else if (variable->type == VAL_NUMBER) { \
+            variable->as.number += REG_C(instr) ? -1 : 1; \
+        } else { \
+            runtimeError(vm, "operand must be a number."); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        R(REG_A(instr)) = *variable; \
+    } while (false)
 
-    result = run();
+    for ever {
+#ifdef PROFILE_OPCODES
+        vm->instructionCount++;
+#endif
+        RegInstr instr = *frame->pc++;
+        switch (REG_OP(instr)) {
+            case REG_MOVE:  R(REG_A(instr)) = R(REG_B(instr)); break;
+            case REG_LOADK: R(REG_A(instr)) = K(REG_B(instr)); break;
+            case REG_NIL:   R(REG_A(instr)) = NIL_VAL; break;
+            case REG_TRUE:  R(REG_A(instr)) = BOOL_VAL(true); break;
+            case REG_FALSE: R(REG_A(instr)) = BOOL_VAL(false); break;
+            case REG_GET_GLOBAL: {
+                ObjString* name = stringFrom(K(REG_B(instr)));
+                GetResult result = hashTableGet(&vm->globals, name);
+                if (!result.found) {
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                R(REG_A(instr)) = result.value;
+                break;
+            }
+            case REG_DEFINE_GLOBAL: {
+                ObjString* name = stringFrom(K(REG_B(instr)));
+                hashTableSet(vm, &vm->globals, name, R(REG_A(instr)));
+                break;
+            }
+            case REG_SET_GLOBAL: {
+                ObjString* name = stringFrom(K(REG_B(instr)));
+                if (hashTableSet(vm, &vm->globals, name, R(REG_A(instr)))) {
+                    hashTableDelete(&vm->globals, name);
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case REG_UPDATE_GLOBAL: {
+                ObjString* name = stringFrom(K(REG_B(instr)));
+                Value* slot = hashTableGetSlot(&vm->globals, name);
+                if (slot == NULL) {
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value rhs = R(REG_A(instr));
+                if (REG_C(instr) == OP_ADD && isObjType(rhs, OBJ_STRING)) {
+                    if (!isObjType(*slot, OBJ_STRING)) {
+                        runtimeError(vm,
+                            "Operands must be two numbers or two strings.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    // Interning only touches the string table, so the slot
+                    // is still valid afterwards.
+                    *slot = OBJ_VAL(concatStrings(vm, stringFrom(*slot),
+                                                  stringFrom(rhs)));
+                } else {
+                    CHECK_NUMBERS(*slot, rhs);
+                    switch (REG_C(instr)) {
+                        case OP_ADD:
+                            *slot = numberAdd(*slot, rhs);
+                            break;
+                        case OP_SUBTRACT:
+                            *slot = numberSubtract(*slot, rhs);
+                            break;
+                        case OP_MULTIPLY:
+                            *slot = numberMultiply(*slot, rhs);
+                            break;
+                        case OP_DIVIDE:
+                            *slot = numberDivide(*slot, rhs);
+                            break;
+                    }
+                }
+                R(REG_A(instr)) = *slot;
+                break;
+            }
+            case REG_STEP_GLOBAL: {
+                ObjString* name = stringFrom(K(REG_B(instr)));
+                Value* slot = hashTableGetSlot(&vm->globals, name);
+                if (slot == NULL) {
+                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                STEP_VARIABLE(slot);
+                break;
+            }
+            case REG_STEP_LOCAL: STEP_VARIABLE(&R(REG_B(instr))); break;
+            case REG_EQUAL:
+                R(REG_A(instr)) = BOOL_VAL(valuesEqual(R(REG_B(instr)),
+                                                       R(REG_C(instr))));
+                break;
+            case REG_LESS:      COMPARE_OP(numberLess);    break;
+            case REG_GREATER:   COMPARE_OP(numberGreater); break;
+            case REG_ADD: {
+                Value b = R(REG_C(instr));
+                Value a = R(REG_B(instr));
+                if (BOTH_NUMBERS(a, b)) {
+                    R(REG_A(instr)) = NUMBER_VAL(a.as.number + b.as.number);
+                } else if (isNumber(a) && isNumber(b)) {
+                    R(REG_A(instr)) = numberAdd(a, b);
+                } else if (isObjType(a, OBJ_STRING) &&
+                           isObjType(b, OBJ_STRING)) {
+                    ObjString* result =
+                        concatStrings(vm, stringFrom(a), stringFrom(b));
+                    R(REG_A(instr)) = OBJ_VAL(result);
+                } else {
+                    runtimeError(vm,
+                        "Operands must be two numbers or two strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case REG_SUBTRACT:  ARITH_OP(numberSubtract); break;
+            case REG_MULTIPLY:  ARITH_OP(numberMultiply); break;
+            case REG_DIVIDE:    ARITH_OP(numberDivide);   break;
+            case REG_NOT: {
+                Value value = R(REG_B(instr));
+                if (value.type != VAL_BOOL) {
+                    runtimeError(vm, "operand must be a boolean.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                R(REG_A(instr)) = BOOL_VAL(!value.as.boolean);
+                break;
+            }
+            case REG_NEGATE: {
+                Value value = R(REG_B(instr));
+                if (!isNumber(value)) {
+                    runtimeError(vm, "operand must be a number.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                R(REG_A(instr)) = numberNegate(value);
+                break;
+            }
+            case REG_JUMP: frame->pc += REG_SBX(instr); break;
+            case REG_JUMP_IF_FALSE: {
+                Value condition = R(REG_A(instr));
+                if (condition.type != VAL_BOOL) {
+                    runtimeError(vm, "Condition must be a boolean.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (!condition.as.boolean) frame->pc += REG_SBX(instr);
+                break;
+            }
+            case REG_COMPARE_JUMP: {
+                Value a = R(REG_A(instr));
+                Value b = R(REG_B(instr));
+                bool holds;
+                if (REG_C(instr) == OP_JUMP_IF_NOT_EQUAL) {
+                    holds = valuesEqual(a, b);
+                } else if (REG_C(instr) == OP_JUMP_IF_EQUAL) {
+                    holds = !valuesEqual(a, b);
+                } else {
+                    CHECK_NUMBERS(a, b);
+                    switch (REG_C(instr)) {
+                        case OP_JUMP_IF_NOT_LESS:
+                            holds = numberLess(a, b);
+                            break;
+                        case OP_JUMP_IF_NOT_GREATER:
+                            holds = numberGreater(a, b);
+                            break;
+                        case OP_JUMP_IF_LESS:
+                            holds = !numberLess(a, b);
+                            break;
+                        default:
+                            holds = !numberGreater(a, b);
+                            break;
+                    }
+                }
+                RegInstr jump = *frame->pc++;
+                if (!holds) frame->pc += REG_SBX(jump);
+                break;
+            }
+            case REG_BUILD_LIST: {
+                u8 count = REG_B(instr);
+                ObjList* list = newList(vm, count);
+                if (count > 0) {
+                    memcpy(list->items.values, &R(REG_A(instr)),
+                           sizeof(Value) * count);
+                }
+                list->items.count = count;
+                R(REG_A(instr)) = OBJ_VAL(list);
+                break;
+            }
+            case REG_GET_INDEX: {
+                if (!isObjType(R(REG_B(instr)), OBJ_LIST)) {
+                    runtimeError(vm, "Only lists can be indexed.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                ObjList* list = listFrom(R(REG_B(instr)));
+                u32 slot;
+                if (!checkListIndex(vm, list, R(REG_C(instr)), &slot)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                R(REG_A(instr)) = list->items.values[slot];
+                break;
+            }
+            case REG_SET_INDEX: {
+                if (!isObjType(R(REG_A(instr)), OBJ_LIST)) {
+                    runtimeError(vm, "Only lists can be indexed.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                ObjList* list = listFrom(R(REG_A(instr)));
+                u32 slot;
+                if (!checkListIndex(vm, list, R(REG_B(instr)), &slot)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                list->items.values[slot] = R(REG_C(instr));
+                break;
+            }
+            case REG_LIST_LENGTH: {
+                if (!isObjType(R(REG_B(instr)), OBJ_LIST)) {
+                    runtimeError(vm, "Only lists have a length.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                u32 length = listFrom(R(REG_B(instr)))->items.count;
+                R(REG_A(instr)) = INT_VAL(length);
+                break;
+            }
+            case REG_LIST_APPEND: {
+                if (!isObjType(R(REG_A(instr)), OBJ_LIST)) {
+                    runtimeError(vm, "Can only append to a list.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                appendList(vm, listFrom(R(REG_A(instr))), R(REG_B(instr)));
+                break;
+            }
+            case REG_LIST_KERNEL: {
+                ListKernel kernel = (ListKernel)REG_B(instr);
+                vm->stackTop = &R(REG_A(instr)) + listKernelArity(kernel) + 1;
+                if (!runListKernel(vm, kernel)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                RESTORE_TOP();
+                break;
+            }
+            case REG_CALL:
+            case REG_TAIL_CALL: {
+                u8 argCount = REG_B(instr);
+                Value* callee = &R(REG_A(instr));
+                vm->stackTop = callee + argCount + 1;
+                bool called = REG_OP(instr) == REG_CALL
+                    ? callValue(vm, *callee, argCount)
+                    : tailCall(vm, *callee, argCount);
+                if (!called) return INTERPRET_RUNTIME_ERROR;
+                frame = &vm->frames[vm->frameCount - 1];
+                RESTORE_TOP();
+                break;
+            }
+            case REG_RETURN: {
+                Value result = R(REG_A(instr));
+                vm->frameCount--;
+                if (vm->frameCount == 0) {
+                    vm->stackTop = frame->slots;
+                    return INTERPRET_OK;
+                }
+
+                // The callee's slot 0 is the caller's call register.
+                frame->slots[0] = result;
+                frame = &vm->frames[vm->frameCount - 1];
+                RESTORE_TOP();
+                break;
+            }
+            case REG_PRINT:
+                writeValue(&vm->output, R(REG_A(instr)));
+                writeChar(&vm->output, '\n');
+                break;
+        }
+    }
+#undef R
+#undef K
+#undef RESTORE_TOP
+#undef BOTH_NUMBERS
+#undef CHECK_NUMBERS
+#undef ARITH_OP
+#undef COMPARE_OP
+#undef STEP_VARIABLE
+}
+
+// Falls back to the stack interpreter, for good, if any function in the
+// program does not fit the register encoding.
+static bool prepareRegisters(VM* vm, ObjFunction* script) {
+    if (translateFunction(vm, script)) {
+#ifdef DEBUG_PRINT_CODE
+        disassembleRegisterCode(vm->out, script->registers, "<script>");
+#endif
+        return true;
+    }
+
+    fprintf(vm->err, "Register backend can't run this program; "
+                     "using the stack interpreter.\n");
+    vm->registerBackend = false;
+    return false;
+}
+
+InterpretResult vmInterpret(VM* vm, const char* source) {
+    // The embedder may have pointed vm->out elsewhere since newVM().
+    vm->output.file = vm->out;
+    if (perfStatsEnabled) perfPhaseBegin(PHASE_COMPILE);
+    ObjFunction* function = compile(vm, source);
+    if (perfStatsEnabled) {
+        perfPhaseEnd(PHASE_COMPILE,
+                     function != NULL ? function->chunk.count : 0);
+    }
+    if (function == NULL) return INTERPRET_COMPILE_ERROR;
+    if (vm->registerBackend) prepareRegisters(vm, function);
+    if (vm->jitEnabled) jitCompile(vm, function);
+
+    // The script function sits in slot 0 of its own frame, like any callee.
+    push(vm, OBJ_VAL(function));
+    call(vm, function, 0);
+
+    if (samplerEnabled) beginSampling(vm);
+#ifdef PROFILE_OPCODES
+    if (profilerEnabled) profileBegin();
+    u64 executedBefore = vm->instructionCount;
+#endif
+    if (perfStatsEnabled) perfPhaseBegin(PHASE_RUN);
+    InterpretResult result = vm->registerBackend ? runRegisters(vm)
+                                                 : runFrame(vm);
+    if (perfStatsEnabled) {
+#ifdef PROFILE_OPCODES
+        // Machine code never passes through the counting dispatch loops.
+        u64 executed = vm->jitEnabled ? PERF_UNITS_UNKNOWN
+                                      : vm->instructionCount - executedBefore;
+#else
+        u64 executed = PERF_UNITS_UNKNOWN;
+#endif
+        perfPhaseEnd(PHASE_RUN, executed);
+    }
+#ifdef PROFILE_OPCODES
+    if (profilerEnabled) profileEnd();
+#endif
+    if (samplerEnabled) endSampling(vm);
 
-cleanup:
-    freeChunk(&chunk);
+    flushOutput(&vm->output);
     return result;
 }
@@ -1,21 +1,53 @@
 #ifndef clox_vm_h
 #define clox_vm_h
 
+#include "arena.h"
 #include "chunk.h"
 #include "value.h"
 #include "hash_table.h"
+#include "jit.h"
+#include "list_kernels.h"
+#include "memory.h"
+#include "object.h"
+#include "register_code.h"
+#include "slab.h"
 
-#define STACK_MAX 256
+#define FRAMES_MAX 64
+#define STACK_MAX (FRAMES_MAX * (U8_MAX + 1))
 
-typedef struct {
-    Chunk* chunk;
-    u8* ip;  // instruction pointer
+// One active call. Frames live in a fixed array inside the VM, so calls
+// and returns never allocate.
+typedef struct CallFrame {
+    ObjFunction* function;
+    u8* ip;        // instruction pointer into function->chunk
+    const RegInstr* pc;  // the same, into function->registers
+    Value* slots;  // first stack slot of this call: the callee, then args
+} CallFrame;
+
+// One interpreter instance. Nothing in the VM, compiler or tokenizer is
+// process-global, so independent VMs may run concurrently on separate
+// threads as long as each VM is only used by one thread at a time.
+struct VM {
+    CallFrame frames[FRAMES_MAX];
+    u32 frameCount;
     Value stack[STACK_MAX];
     Value* stackTop;
     HashTable globals;
     HashTable strings;
+    bool sharedStrings;  // also intern through the process-wide table
     Obj* objects;
-} VM;
+    FILE* out;  // program output, stdout unless the embedder redirects it
+    FILE* err;  // compile and runtime errors, stderr by default
+    OutputBuffer output;  // print goes through here on its way to out
+    MemStats memStats;
+    Allocator allocator;
+    Arena arena;  // compilation artifacts, released all at once by freeVM
+    Slabs slabs;  // objects and short strings, likewise
+    bool registerBackend;  // run register code instead of stack bytecode
+    bool jitEnabled;       // compile functions to machine code first
+    // Only counted when PROFILE_OPCODES is defined, and never by JIT code.
+    u64 instructionCount;
+};
 
 typedef enum {
     INTERPRET_OK,
@@ -23,18 +55,37 @@ typedef enum {
     INTERPRET_RUNTIME_ERROR,
 } InterpretResult;
 
-extern VM vm;
+VM* newVM(void);
+// Everything the VM allocates, itself included, goes through `allocator`.
+VM* newVMWithAllocator(Allocator allocator);
+void freeVM(VM* vm);
+
+// Binds a C function to a global name. Pass NATIVE_VARIADIC as the arity
+// to skip the argument count check.
+void defineNative(VM* vm, const char* name, NativeFn function, i32 arity);
+// Reports an error with a stack trace and unwinds the VM; for natives.
+void runtimeError(VM* vm, const char* format, ...);
+
+// Checks that `index` is an integer inside the list's bounds.
+bool checkListIndex(VM* vm, ObjList* list, Value index, u32* slot);
+// Replaces the receiver list (and argument, if any) on top of the stack
+// with the kernel's result.
+bool runListKernel(VM* vm, ListKernel kernel);
 
-void initVM(void);
-void freeVM(void);
+InterpretResult vmInterpret(VM* vm, const char* source);
 
-InterpretResult interpret(const char* source);
+// For JIT-compiled code. Calls the callee below the top argCount values
+// and runs it to completion, leaving its result in the callee's slot.
+bool callFromJit(VM* vm, u32 argCount);
+// Replaces the current frame with the callee. A native callee has already
+// left its result by the time this returns JIT_RETURN.
+JitStatus tailCallFromJit(VM* vm, u32 argCount);
 
-void push(Value value);
-Value pop(void);
-Value peek(i32 distance);
-void replaceTop(Value value);
-Value top(void);
-Value* top_mut(void);
+void push(VM* vm, Value value);
+Value pop(VM* vm);
+Value peek(VM* vm, i32 distance);
+void replaceTop(VM* vm, Value value);
+Value top(VM* vm);
+Value* top_mut(VM* vm);
 
 #endif